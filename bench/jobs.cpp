@@ -0,0 +1,96 @@
+// overhead of spawning, stealing and chaining jobs in the job system
+#include "../src/jobs.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace vx;
+
+static const int JOBS = 200000;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+// something for a job to chew on that the compiler can't throw away
+static void work(int iters) {
+  volatile float x = 1;
+  for (int i = 0; i < iters; i++)
+    x = x * 1.0001f + 0.5f;
+}
+
+int main() {
+  JobSystem jobs;
+  std::printf("%u workers\n", jobs.thread_count());
+
+  // spawning from the main thread, which never runs them itself until the
+  // final wait, so nearly everything gets stolen
+  {
+    std::vector<Job> all;
+    all.reserve(JOBS);
+    auto before = jobs.stats();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < JOBS; i++)
+      all.push_back(jobs.spawn([] { }));
+    double spawn = elapsed_ns(start);
+    jobs.wait(jobs.spawn([] { }, all));
+    double total = elapsed_ns(start);
+    auto after = jobs.stats();
+
+    std::printf("spawn:      %8.1f ns/job\n", spawn / JOBS);
+    std::printf("steal:      %8.1f ns/job, %.1f%% stolen\n", total / JOBS,
+      100. * (after.stolen - before.stolen) / (after.executed - before.executed));
+  }
+
+  // a job fanning out children from a worker, so they land on its own queue
+  // and the others have to steal them
+  {
+    auto start = std::chrono::steady_clock::now();
+    auto before = jobs.stats();
+    std::vector<Job> children;
+    children.reserve(JOBS);
+    jobs.wait(jobs.spawn([&] {
+      for (int i = 0; i < JOBS; i++)
+        children.push_back(jobs.spawn([] { work(100); }));
+    }));
+    jobs.wait(jobs.spawn([] { }, children));
+    auto after = jobs.stats();
+
+    std::printf("fan out:    %8.1f ns/job, %.1f%% stolen\n",
+      elapsed_ns(start) / JOBS,
+      100. * (after.stolen - before.stolen) / (after.executed - before.executed));
+  }
+
+  // a chain where every job waits on the last, so this is pure scheduling
+  // latency with no parallelism at all
+  {
+    auto start = std::chrono::steady_clock::now();
+    Job last;
+    for (int i = 0; i < JOBS / 10; i++)
+      last = jobs.spawn([] { }, {last});
+    jobs.wait(last);
+    std::printf("dependency: %8.1f ns/job\n", elapsed_ns(start) / (JOBS / 10));
+  }
+
+  // scaling of a fixed amount of real work with thread count
+  {
+    double single = 0;
+    for (unsigned threads : {1u, jobs.thread_count()}) {
+      JobSystem pool(threads);
+      std::vector<Job> all;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < JOBS / 100; i++)
+        all.push_back(pool.spawn([] { work(20000); }));
+      pool.wait(pool.spawn([] { }, all));
+      double ns = elapsed_ns(start);
+      if (threads == 1)
+        single = ns;
+      std::printf("%2u workers: %8.2f ms, %.2fx\n", threads, ns / 1e6,
+        single / ns);
+    }
+  }
+
+  return 0;
+}
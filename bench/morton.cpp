@@ -0,0 +1,136 @@
+// linear [z][y][x] against morton ordered voxels for what the cpu does with a
+// chunk: generating it, scanning every voxel's neighbours and building its
+// octree. the gpu side, optimal against linear tiled images, is measured
+// with make replay, see Makefile
+#include "../src/morton.hpp"
+#include "../src/octree.hpp"
+#include "../src/terrain.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using namespace vx;
+
+static const int CHUNKS = 64;
+
+static_assert(morton_encode(1, 0, 0) == 1 && morton_encode(0, 1, 0) == 2 &&
+  morton_encode(0, 0, 1) == 4);
+static_assert(morton_x(morton_encode(5, 9, 1000)) == 5 &&
+  morton_y(morton_encode(5, 9, 1000)) == 9 &&
+  morton_z(morton_encode(5, 9, 1000)) == 1000);
+static_assert(morton_inc(morton_encode(3, 7, 1), MORTON_X) ==
+  morton_encode(4, 7, 1));
+static_assert(morton_dec(morton_encode(3, 8, 1), MORTON_Y) ==
+  morton_encode(3, 7, 1));
+
+static double ns_per_voxel(int count,
+  const std::function<void(int)> &run) {
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < CHUNKS; n++)
+    run(n);
+  double ns = std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - start).count();
+  return ns / (double(CHUNKS) * count * count * count);
+}
+
+// solid voxels with an empty neighbour, the scan meshing or lighting would do
+static size_t exposed_linear(const uint32_t *voxels, int count) {
+  size_t exposed = 0;
+  size_t i = 0;
+  size_t row = count, slice = count * count;
+  for (int z = 0; z < count; z++) {
+    for (int y = 0; y < count; y++) {
+      for (int x = 0; x < count; x++, i++) {
+        if (!voxels[i])
+          continue;
+        exposed += (x > 0 && !voxels[i - 1]) ||
+          (x < count - 1 && !voxels[i + 1]) ||
+          (y > 0 && !voxels[i - row]) ||
+          (y < count - 1 && !voxels[i + row]) ||
+          (z > 0 && !voxels[i - slice]) ||
+          (z < count - 1 && !voxels[i + slice]);
+      }
+    }
+  }
+  return exposed;
+}
+
+// the same, walking the grid in morton order
+static size_t exposed_morton(const uint32_t *voxels, int count) {
+  size_t exposed = 0;
+  uint32_t total = count * count * count;
+
+  // an axis is at its edge when its bits are all clear or all set, which
+  // saves decoding
+  uint32_t x_bits = MORTON_X & (total - 1);
+  uint32_t y_bits = MORTON_Y & (total - 1);
+  uint32_t z_bits = MORTON_Z & (total - 1);
+  for (uint32_t code = 0; code < total; code++) {
+    if (!voxels[code])
+      continue;
+    uint32_t x = code & x_bits, y = code & y_bits, z = code & z_bits;
+    exposed += (x && !voxels[morton_dec(code, MORTON_X)]) ||
+      (x != x_bits && !voxels[morton_inc(code, MORTON_X)]) ||
+      (y && !voxels[morton_dec(code, MORTON_Y)]) ||
+      (y != y_bits && !voxels[morton_inc(code, MORTON_Y)]) ||
+      (z && !voxels[morton_dec(code, MORTON_Z)]) ||
+      (z != z_bits && !voxels[morton_inc(code, MORTON_Z)]);
+  }
+  return exposed;
+}
+
+int main() {
+  NoiseGenerator terrain;
+
+  std::printf("%5s %-16s %10s %10s %8s\n", "count", "pass", "linear",
+    "morton", "ratio");
+  for (int count : {16, 32, 64}) {
+    size_t size = size_t(count) * count * count;
+    std::vector<uint32_t> linear(CHUNKS * size);
+    std::vector<uint32_t> morton(CHUNKS * size);
+
+    // the chunks in a 4x4x4 block, through the surface
+    auto generate = [&](int n) {
+      terrain.generate(n % 4, n / 4 % 4 - 2, n / 16, count, &linear[n * size]);
+    };
+
+    // noise is generated a row at a time, so a morton chunk costs a linear
+    // one plus reordering it
+    double gen = ns_per_voxel(count, generate);
+    double gen_morton = ns_per_voxel(count, [&](int n) {
+      generate(n);
+      to_morton(&linear[n * size], count, &morton[n * size]);
+    });
+
+    size_t linear_exposed = 0, morton_exposed = 0;
+    double scan = ns_per_voxel(count, [&](int n) {
+      linear_exposed += exposed_linear(&linear[n * size], count);
+    });
+    double scan_morton = ns_per_voxel(count, [&](int n) {
+      morton_exposed += exposed_morton(&morton[n * size], count);
+    });
+
+    size_t linear_nodes = 0, morton_nodes = 0;
+    double build = ns_per_voxel(count, [&](int n) {
+      linear_nodes += Octree(&linear[n * size], count).nodes().size();
+    });
+    double build_morton = ns_per_voxel(count, [&](int n) {
+      morton_nodes += Octree(&morton[n * size], count,
+        VoxelLayout::Morton).nodes().size();
+    });
+
+    if (linear_exposed != morton_exposed || linear_nodes != morton_nodes) {
+      std::printf("layouts disagree at count %d\n", count);
+      return 1;
+    }
+
+    std::printf("%5d %-16s %10.2f %10.2f %7.2fx\n", count, "generate ns/vx",
+      gen, gen_morton, gen / gen_morton);
+    std::printf("%5d %-16s %10.2f %10.2f %7.2fx\n", count, "neighbours ns/vx",
+      scan, scan_morton, scan / scan_morton);
+    std::printf("%5d %-16s %10.2f %10.2f %7.2fx\n", count, "octree ns/vx",
+      build, build_morton, build / build_morton);
+  }
+}
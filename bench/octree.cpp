@@ -0,0 +1,295 @@
+// compares the plain dda that shader.slang used to do, the occupancy brick
+// skipping it does now and the octree descent on the cpu, over the same rays
+// and voxel data. the octree's other queries are checked against the voxels
+// first, failing outright if they're wrong
+#include "../src/occupancy.hpp"
+#include "../src/octree.hpp"
+#include "../src/palette.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace vx;
+
+struct Scene {
+  const char *name;
+  int count;
+  std::vector<uint32_t> voxels;
+};
+
+struct Ray {
+  float pos[3];
+  float dir[3];
+};
+
+struct Result {
+  double ns_per_ray;
+  double steps;
+  int hits;
+};
+
+static const int RAYS = 200000;
+static const int LIMIT = 1 << 16;
+static const float END = 100;
+
+// the sphere on a checkerboard floor that Chunk generates
+static Scene sphere(int count) {
+  Scene scene { "sphere", count, std::vector<uint32_t>(count * count * count) };
+  float radius_sq = (count - 1) / 2.f * (count - 1) / 2.f;
+  float c = count / 2.f;
+  for (int z = 0; z < count; z++) {
+    for (int y = 0; y < count; y++) {
+      for (int x = 0; x < count; x++) {
+        float dist = (x - c) * (x - c) + (y - c) * (y - c) + (z - c) * (z - c);
+        uint32_t voxel = (x + y + z) & 1 ? 1 : 2;
+        if (y == 0 || dist < radius_sq)
+          scene.voxels[(z * count + y) * count + x] = voxel;
+      }
+    }
+  }
+
+  return scene;
+}
+
+// a handful of small floating spheres, mostly air
+static Scene sparse(int count) {
+  Scene scene { "sparse", count, std::vector<uint32_t>(count * count * count) };
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> coord(0, count - 1);
+  float radius = count / 16.f;
+  for (int n = 0; n < 6; n++) {
+    int cx = coord(rng), cy = coord(rng), cz = coord(rng);
+    for (int z = 0; z < count; z++) {
+      for (int y = 0; y < count; y++) {
+        for (int x = 0; x < count; x++) {
+          float dist = std::hypot(x - cx, y - cy, z - cz);
+          if (dist < radius)
+            scene.voxels[(z * count + y) * count + x] = 1 + (n & 1);
+        }
+      }
+    }
+  }
+
+  return scene;
+}
+
+// nothing at all, and nothing but one type, which both collapse to the root
+static Scene empty(int count) {
+  return { "empty", count, std::vector<uint32_t>(count * count * count) };
+}
+
+static Scene solid(int count) {
+  return { "solid", count, std::vector<uint32_t>(count * count * count, 2) };
+}
+
+// whether Octree::at with a size is solid exactly where some voxel in that
+// cell is, which is what the clipmap's coarser levels rely on
+static bool check_at(const Scene &scene, const Octree &octree) {
+  int n = scene.count;
+  for (int size : {1, 2, 4}) {
+    for (int z = 0; z < n; z += size) {
+      for (int y = 0; y < n; y += size) {
+        for (int x = 0; x < n; x += size) {
+          bool any = false;
+          for (int k = z; k < z + size; k++) {
+            for (int j = y; j < y + size; j++) {
+              for (int i = x; i < x + size; i++)
+                any |= scene.voxels[(k * n + j) * n + i] != 0;
+            }
+          }
+          if (any != (octree.at(x, y, z, size) != 0))
+            return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+// whether Octree::bounds is the smallest box around the solid voxels, which
+// chunks are drawn and marched within, and nothing for an empty scene
+static bool check_bounds(const Scene &scene, const Octree &octree) {
+  int n = scene.count;
+  int lo[3] = {n, n, n};
+  int hi[3] = {0, 0, 0};
+  for (int z = 0; z < n; z++) {
+    for (int y = 0; y < n; y++) {
+      for (int x = 0; x < n; x++) {
+        if (!scene.voxels[(z * n + y) * n + x])
+          continue;
+        int voxel[3] = {x, y, z};
+        for (int i = 0; i < 3; i++) {
+          lo[i] = std::min(lo[i], voxel[i]);
+          hi[i] = std::max(hi[i], voxel[i] + 1);
+        }
+      }
+    }
+  }
+  if (lo[0] >= hi[0]) {
+    for (int i = 0; i < 3; i++)
+      lo[i] = hi[i] = 0;
+  }
+
+  auto bounds = octree.bounds();
+  for (int i = 0; i < 3; i++) {
+    if (bounds.lo[i] != lo[i] || bounds.hi[i] != hi[i])
+      return false;
+  }
+  return true;
+}
+
+// the original raymarch from shader.slang: starts from the camera and steps
+// one voxel at a time, treating anything outside the chunk as empty
+static Octree::Hit dense_dda(const Scene &scene, const Ray &ray, int limit,
+  float start, float end) {
+  int n = scene.count;
+  int coord[3], step[3];
+  float t_max[3], t_delta[3];
+  for (int i = 0; i < 3; i++) {
+    float origin = ray.pos[i] + start * ray.dir[i];
+    coord[i] = static_cast<int>(std::floor(origin * n));
+    step[i] = ray.dir[i] > 0 ? 1 : ray.dir[i] < 0 ? -1 : 0;
+    float cell = step[i] > 0 ? coord[i] + 1 : coord[i];
+    t_max[i] = step[i] ? (cell / n - origin) / ray.dir[i] : INFINITY;
+    t_delta[i] = step[i] ? 1.f / n / std::abs(ray.dir[i]) : INFINITY;
+  }
+
+  Octree::Hit hit { .voxel = 0, .t = end, .normal = {0, 0, 0}, .steps = 0 };
+  float t = start;
+  while (hit.steps < limit && t < end) {
+    hit.steps++;
+    int axis = t_max[0] < t_max[1]
+      ? (t_max[0] < t_max[2] ? 0 : 2)
+      : (t_max[1] < t_max[2] ? 1 : 2);
+    t = start + t_max[axis];
+    t_max[axis] += t_delta[axis];
+    coord[axis] += step[axis];
+
+    if (coord[0] < 0 || coord[1] < 0 || coord[2] < 0 ||
+        coord[0] >= n || coord[1] >= n || coord[2] >= n)
+      continue;
+    uint32_t voxel = scene.voxels[(coord[2] * n + coord[1]) * n + coord[0]];
+    if (voxel) {
+      hit.voxel = voxel;
+      hit.t = t;
+      hit.normal[axis] = -step[axis];
+      return hit;
+    }
+  }
+
+  return hit;
+}
+
+// rays from a shell around the chunk aimed at random points inside it, like a
+// camera a few chunks away
+static std::vector<Ray> make_rays() {
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> unit(0, 1);
+  std::normal_distribution<float> normal(0, 1);
+  std::vector<Ray> rays(RAYS);
+  for (auto &ray : rays) {
+    float d[3] = {normal(rng), normal(rng), normal(rng)};
+    float len = std::hypot(d[0], d[1], d[2]);
+    float target[3] = {unit(rng), unit(rng), unit(rng)};
+    float len_dir = 0;
+    for (int i = 0; i < 3; i++) {
+      ray.pos[i] = .5f + 3 * d[i] / len;
+      ray.dir[i] = target[i] - ray.pos[i];
+      len_dir += ray.dir[i] * ray.dir[i];
+    }
+    for (int i = 0; i < 3; i++)
+      ray.dir[i] /= std::sqrt(len_dir);
+  }
+
+  return rays;
+}
+
+static Result run(const std::vector<Ray> &rays,
+  const std::function<Octree::Hit(const Ray &)> &cast) {
+  Result result {0, 0, 0};
+  auto begin = std::chrono::steady_clock::now();
+  for (auto &ray : rays) {
+    auto hit = cast(ray);
+    result.steps += hit.steps;
+    result.hits += hit.voxel != 0;
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  result.ns_per_ray = std::chrono::duration<double, std::nano>(end - begin)
+    .count() / rays.size();
+  result.steps /= rays.size();
+  return result;
+}
+
+static void report(const Scene &scene, const char *method, size_t bytes,
+  const Result &result, int mismatches) {
+  std::printf("%-8s %5d %-7s %10zu %10.1f %10.1f %7.2f%%\n", scene.name,
+    scene.count, method, bytes, result.ns_per_ray, result.steps,
+    100. * (RAYS - mismatches) / RAYS);
+}
+
+int main() {
+  for (int count : {8, 16, 32, 64}) {
+    for (auto scene : {sphere(count), sparse(count), empty(count),
+        solid(count)}) {
+      Octree octree(scene.voxels.data(), count);
+      if (!check_at(scene, octree)) {
+        std::printf("octree at disagrees with %s at count %d\n", scene.name,
+          count);
+        return 1;
+      }
+      if (!check_bounds(scene, octree)) {
+        std::printf("octree bounds disagree with %s at count %d\n",
+          scene.name, count);
+        return 1;
+      }
+    }
+  }
+
+  auto rays = make_rays();
+  std::printf("%-8s %5s %-7s %10s %10s %10s %8s\n", "scene", "count",
+    "method", "bytes", "ns/ray", "steps/ray", "match");
+
+  for (int count : {8, 16, 32, 64}) {
+    for (auto scene : {sphere(count), sparse(count)}) {
+      PalettedVoxels voxels(scene.voxels.data(), scene.voxels.size());
+      Occupancy occupancy(voxels, count);
+      Octree octree(scene.voxels.data(), count);
+
+      int brick_mismatches = 0;
+      int svo_mismatches = 0;
+      for (auto &ray : rays) {
+        auto a = dense_dda(scene, ray, LIMIT, .1, END);
+        auto b = occupancy.raycast(voxels, ray.pos, ray.dir, LIMIT, .1, END);
+        auto c = octree.raycast(ray.pos, ray.dir, LIMIT, .1, END);
+        brick_mismatches += a.voxel != b.voxel;
+        svo_mismatches += a.voxel != c.voxel;
+      }
+
+      auto dense = run(rays, [&](const Ray &ray) {
+        return dense_dda(scene, ray, LIMIT, .1, END);
+      });
+      auto brick = run(rays, [&](const Ray &ray) {
+        return occupancy.raycast(voxels, ray.pos, ray.dir, LIMIT, .1, END);
+      });
+      auto svo = run(rays, [&](const Ray &ray) {
+        return octree.raycast(ray.pos, ray.dir, LIMIT, .1, END);
+      });
+
+      report(scene, "dense", scene.voxels.size() * sizeof(uint32_t), dense, 0);
+      report(scene, "bricks", voxels.bytes() +
+        occupancy.bricks().size() * sizeof(uint64_t), brick,
+        brick_mismatches);
+      report(scene, "svo", octree.nodes().size() * sizeof(uint32_t), svo,
+        svo_mismatches);
+    }
+  }
+
+  return 0;
+}
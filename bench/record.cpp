@@ -0,0 +1,132 @@
+// the cpu side of Renderer::draw_parallel at the chunk counts it's meant for:
+// the per chunk draws split into a group per worker plus the main thread,
+// each recorded on a job into a stream of its own, then gathered in group
+// order. recording is stood in for by writing what Chunk::render records,
+// so this measures how the split scales and what it costs, not the driver.
+// the driver's share is measured with make replay --per-chunk, see Makefile
+#include "../src/jobs.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace vx;
+
+static const int FRAMES = 50;
+
+// what Chunk::render records for each chunk: a descriptor set bind, the
+// chunk's slot as a push constant and a 36 vertex draw
+struct Draw {
+  uint64_t set;
+  uint32_t slot;
+  uint32_t vertices;
+};
+
+struct Chunk {
+  uint64_t set;
+  uint32_t slot;
+  bool stale;
+  bool empty;
+};
+
+// stream stands in for a secondary command buffer, and a chain of multiplies
+// for the driver encoding the draw, around 100ns of it per chunk
+static void record(std::vector<Draw> &stream, Chunk &chunk) {
+  if (chunk.stale)
+    chunk.stale = false;
+  if (chunk.empty)
+    return;
+
+  uint64_t set = chunk.set;
+  for (int i = 0; i < 128; i++)
+    set = set * 6364136223846793005ull + 1442695040888963407ull;
+  stream.push_back({ set, chunk.slot, 36 });
+}
+
+// chunks loaded within radius chunks of the camera, as World loads them
+static size_t loaded(int radius) {
+  size_t count = 0;
+  for (int x = -radius; x <= radius; x++) {
+    for (int y = -radius; y <= radius; y++) {
+      for (int z = -radius; z <= radius; z++) {
+        if (x * x + y * y + z * z <= radius * radius)
+          count++;
+      }
+    }
+  }
+  return count;
+}
+
+static double ms_per_frame(JobSystem *jobs, std::vector<Chunk> &chunks,
+  std::vector<std::vector<Draw>> &streams, uint64_t &check) {
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < FRAMES; frame++) {
+    size_t count = chunks.size();
+    size_t groups = jobs ?
+      std::min<size_t>(jobs->thread_count() + 1, count) : 1;
+    for (size_t g = 0; g < groups; g++)
+      streams[g].clear();
+
+    auto record_group = [&](size_t g) {
+      size_t first = count * g / groups;
+      size_t last = count * (g + 1) / groups;
+      for (size_t i = first; i < last; i++)
+        record(streams[g], chunks[i]);
+    };
+
+    if (jobs) {
+      std::vector<Job> recorded;
+      for (size_t g = 0; g < groups; g++)
+        recorded.push_back(jobs->spawn([&, g] { record_group(g); }));
+      jobs->wait(jobs->spawn([] { }, recorded));
+    } else record_group(0);
+
+    // executeCommands runs them in group order
+    for (size_t g = 0; g < groups; g++) {
+      for (auto &draw : streams[g])
+        check += draw.set;
+    }
+  }
+
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count() / FRAMES;
+}
+
+int main() {
+  JobSystem all;
+  std::printf("%u workers\n", all.thread_count());
+
+  uint64_t check = 0;
+  for (int radius : {3, 8, 14, 18}) {
+    std::vector<Chunk> chunks(loaded(radius));
+    for (size_t i = 0; i < chunks.size(); i++) {
+      chunks[i] = {
+        .set = i * 0x9e3779b97f4a7c15ull,
+        .slot = static_cast<uint32_t>(i),
+        .stale = false,
+        .empty = i % 5 == 0
+      };
+    }
+    std::vector<std::vector<Draw>> streams(all.thread_count() + 1);
+
+    double serial = ms_per_frame(nullptr, chunks, streams, check);
+    std::printf("radius %2d, %6zu chunks: serial %7.3f ms", radius,
+      chunks.size(), serial);
+    for (unsigned threads : {1u, 2u, 4u, all.thread_count()}) {
+      if (threads > all.thread_count())
+        continue;
+      JobSystem jobs(threads);
+      double ms = ms_per_frame(&jobs, chunks, streams, check);
+      std::printf(", %u workers %7.3f ms %.2fx", threads, ms, serial / ms);
+      if (threads == all.thread_count())
+        break;
+    }
+    std::printf("\n");
+  }
+
+  // so the recording can't be thrown away
+  std::printf("checksum %llx\n", static_cast<unsigned long long>(check));
+  return 0;
+}
@@ -0,0 +1,99 @@
+// terrain generation throughput for every noise kernel and instruction set,
+// single threaded and then spread over the job system, plus how small the
+// generated chunks get once they're palette compressed
+#include "../src/jobs.hpp"
+#include "../src/palette.hpp"
+#include "../src/terrain.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace vx;
+
+static const int COUNT = 32;
+static const int CHUNKS = 64;
+static const size_t VOXELS = CHUNKS * COUNT * COUNT * COUNT;
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+// the chunks in a 4x4x4 block, so some are all air, some all ground and
+// some have the surface running through them
+static void chunk_pos(int n, int &x, int &y, int &z) {
+  x = n % 4;
+  y = n / 4 % 4 - 2;
+  z = n / 16;
+}
+
+int main() {
+  std::vector<uint32_t> reference(VOXELS);
+  std::vector<uint32_t> voxels(VOXELS);
+
+  std::printf("%-8s %-7s %14s %8s %6s\n", "kernel", "isa", "voxels/s",
+    "speedup", "match");
+  for (auto kernel : {NoiseKernel::Perlin, NoiseKernel::Simplex}) {
+    double scalar = 0;
+    for (auto isa : {Isa::Scalar, Isa::Sse41, Isa::Avx2}) {
+      if (!isa_supported(isa))
+        continue;
+
+      NoiseGenerator terrain({ .kernel = kernel }, isa);
+      auto &out = isa == Isa::Scalar ? reference : voxels;
+      auto start = std::chrono::steady_clock::now();
+      for (int n = 0; n < CHUNKS; n++) {
+        int x, y, z;
+        chunk_pos(n, x, y, z);
+        terrain.generate(x, y, z, COUNT, &out[n * COUNT * COUNT * COUNT]);
+      }
+      double rate = VOXELS / seconds(start);
+      if (isa == Isa::Scalar)
+        scalar = rate;
+
+      bool match = !std::memcmp(reference.data(), out.data(),
+        VOXELS * sizeof(uint32_t));
+      std::printf("%-8s %-7s %14.0f %7.2fx %6s\n", to_string(kernel),
+        to_string(isa), rate, rate / scalar, match ? "yes" : "no");
+    }
+  }
+
+  // resident and upload sizes of the chunks from the last run
+  size_t raw = VOXELS * sizeof(uint32_t);
+  size_t packed = 0;
+  size_t gpu = 0;
+  for (int n = 0; n < CHUNKS; n++) {
+    PalettedVoxels chunk(&voxels[n * COUNT * COUNT * COUNT],
+      COUNT * COUNT * COUNT);
+    packed += chunk.bytes();
+    gpu += chunk.size() * chunk.gpu_index_size() +
+      chunk.palette().size() * sizeof(uint32_t);
+  }
+  std::printf("\n%-16s %10zu bytes\n", "uint32", raw);
+  std::printf("%-16s %10zu bytes %6.1fx smaller\n", "paletted", packed,
+    static_cast<double>(raw) / packed);
+  std::printf("%-16s %10zu bytes %6.1fx smaller\n\n", "paletted upload",
+    gpu, static_cast<double>(raw) / gpu);
+
+  // the same work as chunk jobs, the way World generates them
+  JobSystem jobs;
+  for (auto kernel : {NoiseKernel::Perlin, NoiseKernel::Simplex}) {
+    NoiseGenerator terrain({ .kernel = kernel });
+    std::vector<Job> all;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < CHUNKS; n++) {
+      all.push_back(jobs.spawn([&, n] {
+        int x, y, z;
+        chunk_pos(n, x, y, z);
+        terrain.generate(x, y, z, COUNT, &voxels[n * COUNT * COUNT * COUNT]);
+      }));
+    }
+    jobs.wait(jobs.spawn([] { }, all));
+    std::printf("%-8s %-7s %14.0f on %u workers + main\n", to_string(kernel),
+      to_string(best_isa()), VOXELS / seconds(start), jobs.thread_count());
+  }
+
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include "allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace vx;
+
+static vk::DeviceSize align_up(vk::DeviceSize x, vk::DeviceSize alignment) {
+  return (x + alignment - 1) / alignment * alignment;
+}
+
+vk::DeviceSize FreeList::take(vk::DeviceSize size, vk::DeviceSize alignment) {
+  for (auto it = ranges.begin(); it != ranges.end(); it++) {
+    auto [start, length] = *it;
+    vk::DeviceSize offset = align_up(start, alignment);
+    if (offset + size > start + length)
+      continue;
+
+    // whatever's left either side of the aligned range stays free
+    ranges.erase(it);
+    if (offset > start)
+      ranges[start] = offset - start;
+    if (offset + size < start + length)
+      ranges[offset + size] = start + length - offset - size;
+    return offset;
+  }
+
+  return NONE;
+}
+
+void FreeList::give(vk::DeviceSize offset, vk::DeviceSize size) {
+  auto next = ranges.lower_bound(offset);
+
+  // merge with the range after
+  if (next != ranges.end() && offset + size == next->first) {
+    size += next->second;
+    next = ranges.erase(next);
+  }
+
+  // and the one before
+  if (next != ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      prev->second += size;
+      return;
+    }
+  }
+
+  ranges[offset] = size;
+}
+
+vk::DeviceMemory Allocation::memory() const {
+  return block ? *block->memory : vk::DeviceMemory();
+}
+
+void *Allocation::mapped() const {
+  if (!block || !block->mapped)
+    return nullptr;
+  return static_cast<char *>(block->mapped) + offset_;
+}
+
+void Allocation::release() {
+  if (allocator)
+    allocator->free(*this);
+  allocator = nullptr;
+  block = nullptr;
+}
+
+void Allocation::swap(Allocation &that) noexcept {
+  std::swap(allocator, that.allocator);
+  std::swap(block, that.block);
+  std::swap(offset_, that.offset_);
+  std::swap(size_, that.size_);
+}
+
+Allocator::Allocator(vk::raii::PhysicalDevice &physical,
+  vk::raii::Device &device)
+  : device (device)
+  , props (physical.getMemoryProperties())
+  , pools (props.memoryTypeCount) { }
+
+uint32_t Allocator::find_type(uint32_t type_bits,
+  vk::MemoryPropertyFlags flags) {
+  for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
+    if ((type_bits & (1 << i)) &&
+      (props.memoryTypes[i].propertyFlags & flags) == flags)
+      return i;
+  }
+
+  throw std::runtime_error("could not find suitable device memory");
+}
+
+vk::DeviceSize Allocator::block_size(uint32_t type) {
+  auto heap = props.memoryHeaps[props.memoryTypes[type].heapIndex].size;
+  return std::min(BLOCK_SIZE, heap / 8);
+}
+
+Allocation::Block &Allocator::new_block(uint32_t type, bool linear,
+  vk::DeviceSize size, bool dedicated) {
+  auto block = std::unique_ptr<Allocation::Block>(new Allocation::Block {
+    .memory = vk::raii::DeviceMemory(device, vk::MemoryAllocateInfo {
+      .allocationSize = size,
+      .memoryTypeIndex = type
+    }),
+    .size = size,
+    .type = type,
+    .linear = linear,
+    .dedicated = dedicated,
+    .mapped = nullptr,
+    .free = FreeList(size)
+  });
+
+  if (props.memoryTypes[type].propertyFlags &
+      vk::MemoryPropertyFlagBits::eHostVisible)
+    block->mapped = block->memory.mapMemory(0, size);
+
+  stats_.blocks++;
+  stats_.reserved += size;
+  stats_.dedicated += dedicated;
+  auto &blocks = pools[type][linear].blocks;
+  blocks.push_back(std::move(block));
+  return *blocks.back();
+}
+
+Allocation Allocator::allocate(const vk::MemoryRequirements &reqs,
+  vk::MemoryPropertyFlags flags, bool linear) {
+  uint32_t type = find_type(reqs.memoryTypeBits, flags);
+  vk::DeviceSize block = block_size(type);
+
+  std::lock_guard guard(lock);
+
+  // anything big enough to waste most of a block gets its own
+  Allocation::Block *found = nullptr;
+  vk::DeviceSize offset = FreeList::NONE;
+  if (reqs.size > block / 2) {
+    found = &new_block(type, linear, reqs.size, true);
+    offset = found->free.take(reqs.size, 1);
+  } else {
+    for (auto &candidate : pools[type][linear].blocks) {
+      if (candidate->dedicated)
+        continue;
+      offset = candidate->free.take(reqs.size, reqs.alignment);
+      if (offset != FreeList::NONE) {
+        found = candidate.get();
+        break;
+      }
+    }
+
+    if (!found) {
+      found = &new_block(type, linear, block, false);
+      offset = found->free.take(reqs.size, reqs.alignment);
+    }
+  }
+
+  stats_.allocations++;
+  stats_.used += reqs.size;
+
+  Allocation allocation;
+  allocation.allocator = this;
+  allocation.block = found;
+  allocation.offset_ = offset;
+  allocation.size_ = reqs.size;
+  return allocation;
+}
+
+void Allocator::free(Allocation &allocation) {
+  std::lock_guard guard(lock);
+  auto *block = allocation.block;
+  block->free.give(allocation.offset_, allocation.size_);
+  stats_.allocations--;
+  stats_.used -= allocation.size_;
+
+  if (!block->free.empty(block->size))
+    return;
+
+  // keep one empty block around so a pool that's emptied and refilled every
+  // frame doesn't allocate every frame
+  Pool &pool = pools[block->type][block->linear];
+  if (!block->dedicated && std::count_if(pool.blocks.begin(),
+      pool.blocks.end(), [](auto &other) {
+        return !other->dedicated && other->free.empty(other->size);
+      }) < 2)
+    return;
+
+  stats_.blocks--;
+  stats_.reserved -= block->size;
+  stats_.dedicated -= block->dedicated;
+  std::erase_if(pool.blocks, [&](auto &other) {
+    return other.get() == block;
+  });
+}
+
+MemoryStats Allocator::stats() {
+  std::lock_guard guard(lock);
+  return stats_;
+}
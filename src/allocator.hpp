@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class Allocator;
+
+// what the allocator is holding on to, for spotting leaks and fragmentation
+struct MemoryStats {
+  // live vkAllocateMemory calls and the bytes in them
+  size_t blocks = 0;
+  vk::DeviceSize reserved = 0;
+
+  // of which, blocks holding a single large resource
+  size_t dedicated = 0;
+
+  // live sub-allocations and the bytes they asked for
+  size_t allocations = 0;
+  vk::DeviceSize used = 0;
+};
+
+// a range of a larger block of device memory, handed back to the allocator
+// when dropped. the resource bound to it has to go first
+class Allocation {
+public:
+  Allocation() = default;
+  Allocation(std::nullptr_t) { }
+  ~Allocation() { release(); }
+
+  Allocation(const Allocation &that) = delete;
+  Allocation &operator=(const Allocation &that) = delete;
+
+  Allocation(Allocation &&that) noexcept { swap(that); }
+
+  Allocation &operator=(Allocation &&that) noexcept {
+    Allocation temp(std::move(that));
+    swap(temp);
+    return *this;
+  }
+
+  bool operator==(std::nullptr_t) const { return allocator == nullptr; }
+
+  vk::DeviceMemory memory() const;
+  vk::DeviceSize offset() const { return offset_; }
+  vk::DeviceSize size() const { return size_; }
+
+  // host visible memory stays mapped for as long as its block lives, as a
+  // block can only be mapped once however many allocations share it. null if
+  // the memory isn't host visible
+  void *mapped() const;
+
+private:
+  struct Block;
+
+  vx::Allocator *allocator = nullptr;
+  Block *block = nullptr;
+  vk::DeviceSize offset_ = 0;
+  vk::DeviceSize size_ = 0;
+
+  void release();
+  void swap(Allocation &that) noexcept;
+
+  friend class vx::Allocator;
+};
+
+// carves buffers and images out of a few big blocks of device memory, rather
+// than making a vkAllocateMemory call for each. there's a pool of blocks per
+// memory type, and each block keeps a free list of the ranges it's given out
+// so freed space is merged back together
+class Allocator {
+public:
+  // big blocks, or an eighth of the heap on small heaps
+  static const vk::DeviceSize BLOCK_SIZE = 64 << 20;
+
+  Allocator(vk::raii::PhysicalDevice &physical, vk::raii::Device &device);
+
+  Allocator(const Allocator &that) = delete;
+  Allocator &operator=(const Allocator &that) = delete;
+
+  // linear is whether the resource is a buffer or linearly tiled image.
+  // linear and optimal resources are kept in separate pools so neighbours
+  // never have to be padded apart by bufferImageGranularity
+  Allocation allocate(const vk::MemoryRequirements &reqs,
+    vk::MemoryPropertyFlags props, bool linear);
+
+  MemoryStats stats();
+
+private:
+  struct Pool {
+    std::vector<std::unique_ptr<Allocation::Block>> blocks;
+  };
+
+  vk::raii::Device &device;
+  vk::PhysicalDeviceMemoryProperties props;
+
+  // indexed by memory type, then by linear or not
+  std::vector<std::array<Pool, 2>> pools;
+  std::mutex lock;
+  MemoryStats stats_;
+
+  uint32_t find_type(uint32_t type_bits, vk::MemoryPropertyFlags flags);
+  vk::DeviceSize block_size(uint32_t type);
+  Allocation::Block &new_block(uint32_t type, bool linear,
+    vk::DeviceSize size, bool dedicated);
+  void free(Allocation &allocation);
+
+  friend class vx::Allocation;
+};
+
+// the ranges of a block that aren't handed out, kept merged with their
+// neighbours. first fit, which keeps long lived chunk buffers packed towards
+// the start of a block and leaves the end free for bigger requests
+class FreeList {
+public:
+  static const vk::DeviceSize NONE = ~vk::DeviceSize(0);
+
+  explicit FreeList(vk::DeviceSize size) { ranges[0] = size; }
+
+  // the offset of a range of size bytes aligned to alignment, or NONE
+  vk::DeviceSize take(vk::DeviceSize size, vk::DeviceSize alignment);
+  void give(vk::DeviceSize offset, vk::DeviceSize size);
+
+  // whether nothing is handed out
+  bool empty(vk::DeviceSize size) const {
+    return ranges.size() == 1 && ranges.begin()->second == size;
+  }
+
+private:
+  // offset to size
+  std::map<vk::DeviceSize, vk::DeviceSize> ranges;
+};
+
+struct Allocation::Block {
+  vk::raii::DeviceMemory memory = nullptr;
+  vk::DeviceSize size;
+  uint32_t type;
+  bool linear;
+  bool dedicated;
+  void *mapped = nullptr;
+  FreeList free;
+};
+
+}
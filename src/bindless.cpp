@@ -0,0 +1,601 @@
+#include "bindless.hpp"
+#include "renderer.hpp"
+#include "shaders.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+using namespace vx;
+
+namespace {
+
+// BindlessParams in shader.slang, shared by the culling and grid passes
+struct BindlessParams {
+  int32_t grid[4];
+  uint32_t chunk_count;
+};
+
+struct OldBuffer {
+  vx::Allocation mem;
+  vk::raii::Buffer buffer;
+};
+
+}
+
+static const auto PUSH_STAGES = vk::ShaderStageFlagBits::eCompute |
+  vk::ShaderStageFlagBits::eFragment;
+
+// a grid the default radius fits in, so most runs never grow it
+static const size_t GRID_MIN = 1024;
+
+Bindless::Bindless(Renderer &render, uint32_t capacity)
+  : render (render)
+  , capacity (capacity)
+  , transforms_ (capacity) {
+  create_layout();
+  create_sets();
+
+  // the culling pass is told how many chunks there are, and the grid pass
+  // where its grid is
+  vk::PushConstantRange push_constants {
+    .stageFlags = PUSH_STAGES,
+    .offset = 0,
+    .size = sizeof(BindlessParams)
+  };
+
+  vk::PipelineLayoutCreateInfo layout_info {
+    .setLayoutCount = 1,
+    .pSetLayouts = &*layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_constants
+  };
+  pipeline_layout = vk::raii::PipelineLayout(render.device().device(),
+    layout_info);
+
+  // hand out low slots first
+  for (uint32_t i = capacity; i-- > 0;)
+    free_slots.push_back(i);
+}
+
+void Bindless::create_layout() {
+  // the arrays are written while frames using other slots are in flight, and
+  // most of them are empty most of the time
+  auto array_flags = vk::DescriptorBindingFlagBits::ePartiallyBound |
+    vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+    vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+  std::array<vk::DescriptorBindingFlags, 12> flags {
+    {}, {}, array_flags, array_flags, array_flags, array_flags, {}, {}, {},
+    {}, {}, {}
+  };
+
+  auto stages = vk::ShaderStageFlagBits::eVertex |
+    vk::ShaderStageFlagBits::eFragment |
+    vk::ShaderStageFlagBits::eCompute;
+  std::array bindings {
+    // camera
+    vk::DescriptorSetLayoutBinding {
+      .binding = 0,
+      .descriptorType = vk::DescriptorType::eUniformBuffer,
+      .descriptorCount = 1,
+      .stageFlags = stages
+    },
+    // chunk infos
+    vk::DescriptorSetLayoutBinding {
+      .binding = 1,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = stages
+    },
+    // voxel images
+    vk::DescriptorSetLayoutBinding {
+      .binding = 2,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .descriptorCount = capacity,
+      .stageFlags = stages
+    },
+    // octrees
+    vk::DescriptorSetLayoutBinding {
+      .binding = 3,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = capacity,
+      .stageFlags = stages
+    },
+    // palettes
+    vk::DescriptorSetLayoutBinding {
+      .binding = 4,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = capacity,
+      .stageFlags = stages
+    },
+    // brick occupancy
+    vk::DescriptorSetLayoutBinding {
+      .binding = 5,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = capacity,
+      .stageFlags = stages
+    },
+    // draw count
+    vk::DescriptorSetLayoutBinding {
+      .binding = 6,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    },
+    // draws
+    vk::DescriptorSetLayoutBinding {
+      .binding = 7,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    },
+    // transforms
+    vk::DescriptorSetLayoutBinding {
+      .binding = 8,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = stages
+    },
+    // chunk grid
+    vk::DescriptorSetLayoutBinding {
+      .binding = 9,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = stages
+    },
+    // traced colour
+    vk::DescriptorSetLayoutBinding {
+      .binding = 10,
+      .descriptorType = vk::DescriptorType::eStorageImage,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    },
+    // traced depth
+    vk::DescriptorSetLayoutBinding {
+      .binding = 11,
+      .descriptorType = vk::DescriptorType::eStorageImage,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    }
+  };
+
+  vk::StructureChain info {
+    vk::DescriptorSetLayoutCreateInfo {
+      .flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+      .bindingCount = bindings.size(),
+      .pBindings = bindings.data()
+    },
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo {
+      .bindingCount = flags.size(),
+      .pBindingFlags = flags.data()
+    }
+  };
+
+  layout = vk::raii::DescriptorSetLayout(render.device().device(),
+    info.get());
+}
+
+void Bindless::create_sets() {
+  const uint32_t frames = Swapchain::MAX_FRAMES_IN_FLIGHT;
+  std::array pool_sizes {
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eUniformBuffer,
+      .descriptorCount = frames
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eSampledImage,
+      .descriptorCount = frames * capacity
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = frames * (5 + 3 * capacity)
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eStorageImage,
+      .descriptorCount = frames * 2
+    }
+  };
+
+  vk::DescriptorPoolCreateInfo pool_info {
+    .flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+    .maxSets = frames,
+    .poolSizeCount = pool_sizes.size(),
+    .pPoolSizes = pool_sizes.data()
+  };
+
+  auto &device = render.device().device();
+  pool = vk::raii::DescriptorPool(device, pool_info);
+
+  std::vector<vk::DescriptorSetLayout> layouts (frames, layout);
+  vk::DescriptorSetAllocateInfo alloc_info {
+    .descriptorPool = pool,
+    .descriptorSetCount = frames,
+    .pSetLayouts = layouts.data()
+  };
+  sets = device.allocateDescriptorSets(alloc_info);
+
+  // transforms are shared by every frame, and only copied to when they change
+  render.device().create_buffer(transform_buffer, transform_mem,
+    capacity * sizeof(ChunkTransform),
+    vk::BufferUsageFlagBits::eStorageBuffer |
+    vk::BufferUsageFlagBits::eTransferDst,
+    vk::MemoryPropertyFlagBits::eDeviceLocal);
+  vk::DescriptorBufferInfo transforms_info {
+    .buffer = transform_buffer,
+    .offset = 0,
+    .range = vk::WholeSize
+  };
+
+  // each frame gets its own chunk infos, rewritten every frame
+  vk::DeviceSize size = capacity * sizeof(ChunkInfo);
+  for (uint32_t i = 0; i < frames; i++) {
+    info_buffers.push_back(nullptr);
+    info_mems.push_back(nullptr);
+    render.device().create_buffer(info_buffers[i], info_mems[i], size,
+      vk::BufferUsageFlagBits::eStorageBuffer,
+      vk::MemoryPropertyFlagBits::eHostVisible |
+      vk::MemoryPropertyFlagBits::eHostCoherent);
+    infos.push_back(reinterpret_cast<ChunkInfo *>(info_mems[i].mapped()));
+
+    // and its own draws, as the gpu rewrites them every frame too
+    draw_buffers.push_back(nullptr);
+    draw_mems.push_back(nullptr);
+    render.device().create_buffer(draw_buffers[i], draw_mems[i],
+      capacity * sizeof(vk::DrawIndirectCommand),
+      vk::BufferUsageFlagBits::eStorageBuffer |
+      vk::BufferUsageFlagBits::eIndirectBuffer,
+      vk::MemoryPropertyFlagBits::eDeviceLocal);
+    count_buffers.push_back(nullptr);
+    count_mems.push_back(nullptr);
+    render.device().create_buffer(count_buffers[i], count_mems[i],
+      sizeof(uint32_t),
+      vk::BufferUsageFlagBits::eStorageBuffer |
+      vk::BufferUsageFlagBits::eIndirectBuffer |
+      vk::BufferUsageFlagBits::eTransferDst,
+      vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+    vk::DescriptorBufferInfo camera_info {
+      .buffer = render.camera_ubo(i),
+      .offset = 0,
+      .range = sizeof(CameraUniforms)
+    };
+
+    vk::DescriptorBufferInfo chunks_info {
+      .buffer = info_buffers[i],
+      .offset = 0,
+      .range = vk::WholeSize
+    };
+
+    vk::DescriptorBufferInfo count_info {
+      .buffer = count_buffers[i],
+      .offset = 0,
+      .range = vk::WholeSize
+    };
+
+    vk::DescriptorBufferInfo draws_info {
+      .buffer = draw_buffers[i],
+      .offset = 0,
+      .range = vk::WholeSize
+    };
+
+    std::array write_sets {
+      vk::WriteDescriptorSet {
+        .dstSet = sets[i],
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eUniformBuffer,
+        .pBufferInfo = &camera_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = sets[i],
+        .dstBinding = 1,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &chunks_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = sets[i],
+        .dstBinding = 6,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &count_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = sets[i],
+        .dstBinding = 7,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &draws_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = sets[i],
+        .dstBinding = 8,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &transforms_info
+      },
+    };
+
+    device.updateDescriptorSets(write_sets, {});
+
+    grid_buffers.push_back(nullptr);
+    grid_mems.push_back(nullptr);
+    grid_capacity.push_back(0);
+    create_grid(i, GRID_MIN);
+    traced_views.push_back(nullptr);
+  }
+}
+
+void Bindless::create_grid(int frame_index, size_t cells) {
+  auto &buffer = grid_buffers[frame_index];
+  auto &mem = grid_mems[frame_index];
+  if (*buffer) {
+    render.retire(std::shared_ptr<OldBuffer>(new OldBuffer {
+      std::move(mem), std::move(buffer)
+    }));
+  }
+
+  // written from the cpu every frame it's drawn with, like the chunk infos
+  grid_capacity[frame_index] = std::bit_ceil(cells);
+  render.device().create_buffer(buffer, mem,
+    grid_capacity[frame_index] * sizeof(uint32_t),
+    vk::BufferUsageFlagBits::eStorageBuffer,
+    vk::MemoryPropertyFlagBits::eHostVisible |
+    vk::MemoryPropertyFlagBits::eHostCoherent);
+
+  vk::DescriptorBufferInfo grid_info {
+    .buffer = buffer,
+    .offset = 0,
+    .range = vk::WholeSize
+  };
+
+  render.device().device().updateDescriptorSets(vk::WriteDescriptorSet {
+    .dstSet = sets[frame_index],
+    .dstBinding = 9,
+    .dstArrayElement = 0,
+    .descriptorCount = 1,
+    .descriptorType = vk::DescriptorType::eStorageBuffer,
+    .pBufferInfo = &grid_info
+  }, {});
+}
+
+BindlessSlot Bindless::acquire() {
+  if (free_slots.empty())
+    throw std::runtime_error("out of bindless chunk slots");
+
+  uint32_t *slot = new uint32_t(free_slots.back());
+  free_slots.pop_back();
+  return BindlessSlot(slot, [this](const uint32_t *slot) {
+    free_slots.push_back(*slot);
+    delete slot;
+  });
+}
+
+void Bindless::write(uint32_t slot, vk::ImageView voxels, vk::Buffer svo,
+  vk::Buffer palette, vk::Buffer bricks) {
+  vk::DescriptorImageInfo image_info {
+    .imageView = voxels,
+    .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+  };
+
+  std::array<vk::DescriptorBufferInfo, 3> buffer_infos {{
+    { .buffer = svo, .offset = 0, .range = vk::WholeSize },
+    { .buffer = palette, .offset = 0, .range = vk::WholeSize },
+    { .buffer = bricks, .offset = 0, .range = vk::WholeSize },
+  }};
+
+  std::vector<vk::WriteDescriptorSet> write_sets;
+  for (auto &set : sets) {
+    write_sets.push_back({
+      .dstSet = set,
+      .dstBinding = 2,
+      .dstArrayElement = slot,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .pImageInfo = &image_info
+    });
+
+    for (uint32_t i = 0; i < buffer_infos.size(); i++) {
+      write_sets.push_back({
+        .dstSet = set,
+        .dstBinding = 3 + i,
+        .dstArrayElement = slot,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &buffer_infos[i]
+      });
+    }
+  }
+
+  render.device().device().updateDescriptorSets(write_sets, {});
+}
+
+void Bindless::set_transform(uint32_t slot, const ChunkTransform &transform) {
+  transforms_[slot] = transform;
+  dirty.push_back(slot);
+}
+
+void Bindless::flush() {
+  if (dirty.empty())
+    return;
+
+  std::sort(dirty.begin(), dirty.end());
+  dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+  // neighbouring slots go in one copy, as chunks loaded together tend to get
+  // slots together. updateBuffer takes at most 64k at a time
+  const size_t max_run = 65536 / sizeof(ChunkTransform);
+  for (size_t i = 0; i < dirty.size();) {
+    size_t first = dirty[i], last = first + 1;
+    for (i++; i < dirty.size() && dirty[i] == last &&
+      last - first < max_run; i++)
+      last++;
+
+    std::vector<ChunkTransform> run(transforms_.begin() + first,
+      transforms_.begin() + last);
+    render.upload([buffer = *transform_buffer, first, run = std::move(run)]
+      (vk::raii::CommandBuffer &commands) {
+      commands.updateBuffer<ChunkTransform>(buffer,
+        first * sizeof(ChunkTransform), run);
+    });
+  }
+  dirty.clear();
+}
+
+void Bindless::cull(const std::vector<ChunkInfo> &chunks) {
+  if (chunks.size() > capacity)
+    throw std::length_error("more chunks than bindless slots");
+
+  culled = chunks.size();
+  if (culled == 0)
+    return;
+
+  int frame_index = render.swapchain().frame_index();
+  std::memcpy(infos[frame_index], chunks.data(),
+    chunks.size() * sizeof(ChunkInfo));
+
+  auto &commands = render.command_buffer();
+  GpuZone zone(render.gpu_timer(), "cull");
+  commands.fillBuffer(count_buffers[frame_index], 0, sizeof(uint32_t), 0);
+
+  vk::MemoryBarrier2 cleared {
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead |
+      vk::AccessFlagBits2::eShaderStorageWrite
+  };
+  commands.pipelineBarrier2({
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &cleared
+  });
+
+  commands.bindPipeline(vk::PipelineBindPoint::eCompute, cull_pipeline);
+  commands.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+    pipeline_layout, 0, *sets[frame_index], nullptr);
+  commands.pushConstants<uint32_t>(pipeline_layout, PUSH_STAGES,
+    offsetof(BindlessParams, chunk_count), culled);
+  commands.dispatch((culled + CULL_GROUP - 1) / CULL_GROUP, 1, 1);
+
+  vk::MemoryBarrier2 written {
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eDrawIndirect,
+    .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead
+  };
+  commands.pipelineBarrier2({
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &written
+  });
+}
+
+void Bindless::draw(uint32_t voxel_count) {
+  if (culled == 0)
+    return;
+
+  int frame_index = render.swapchain().frame_index();
+  auto &commands = render.command_buffer();
+  commands.bindPipeline(vk::PipelineBindPoint::eGraphics,
+    render.chunk_pipeline(pipeline_layout, bindless_shaders,
+      bindless_shaders_len, voxel_count));
+  commands.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+    pipeline_layout, 0, *sets[frame_index], nullptr);
+  commands.drawIndirectCount(draw_buffers[frame_index], 0,
+    count_buffers[frame_index], 0, culled, sizeof(vk::DrawIndirectCommand));
+}
+
+void Bindless::build_pipelines(uint32_t voxel_count) {
+  cull_pipeline = render.create_compute_pipeline(pipeline_layout,
+    bindless_shaders, bindless_shaders_len, "cull_main");
+  render.chunk_pipeline(pipeline_layout, bindless_shaders,
+    bindless_shaders_len, voxel_count);
+  render.chunk_pipeline(pipeline_layout, grid_shaders, grid_shaders_len,
+    voxel_count);
+  render.chunk_compute_pipeline(pipeline_layout, grid_shaders,
+    grid_shaders_len, "trace_main", voxel_count);
+}
+
+void Bindless::write_grid(int frame_index,
+  const std::vector<uint32_t> &cells) {
+  // the frame in flight's last use of its grid is done by now, so it can be
+  // rewritten, or replaced along with its descriptor
+  if (cells.size() > grid_capacity[frame_index])
+    create_grid(frame_index, cells.size());
+  std::memcpy(grid_mems[frame_index].mapped(), cells.data(),
+    cells.size() * sizeof(cells[0]));
+}
+
+void Bindless::draw_grid(uint32_t voxel_count,
+  const std::vector<uint32_t> &cells, glm::ivec3 origin, int size) {
+  int frame_index = render.swapchain().frame_index();
+  write_grid(frame_index, cells);
+
+  auto &commands = render.command_buffer();
+  commands.bindPipeline(vk::PipelineBindPoint::eGraphics,
+    render.chunk_pipeline(pipeline_layout, grid_shaders, grid_shaders_len,
+      voxel_count));
+  commands.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+    pipeline_layout, 0, *sets[frame_index], nullptr);
+  commands.pushConstants<glm::ivec4>(pipeline_layout, PUSH_STAGES,
+    offsetof(BindlessParams, grid), glm::ivec4(origin, size));
+
+  // one triangle covering the screen, see vert_main in shader.slang
+  commands.draw(3, 1, 0, 0);
+}
+
+void Bindless::trace(uint32_t voxel_count,
+  const std::vector<uint32_t> &cells, glm::ivec3 origin, int size) {
+  int frame_index = render.swapchain().frame_index();
+  write_grid(frame_index, cells);
+
+  // the target is only replaced when the swapchain changes size
+  auto &target = render.begin_trace();
+  if (traced_views[frame_index] != *target.color_view) {
+    std::array<vk::DescriptorImageInfo, 2> image_infos {{
+      {
+        .imageView = target.color_view,
+        .imageLayout = vk::ImageLayout::eGeneral
+      },
+      {
+        .imageView = target.depth_view,
+        .imageLayout = vk::ImageLayout::eGeneral
+      },
+    }};
+
+    std::array<vk::WriteDescriptorSet, 2> write_sets;
+    for (uint32_t i = 0; i < write_sets.size(); i++) {
+      write_sets[i] = {
+        .dstSet = sets[frame_index],
+        .dstBinding = 10 + i,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageImage,
+        .pImageInfo = &image_infos[i]
+      };
+    }
+    render.device().device().updateDescriptorSets(write_sets, {});
+    traced_views[frame_index] = *target.color_view;
+  }
+
+  auto &commands = render.command_buffer();
+  {
+    GpuZone zone(render.gpu_timer(), "trace");
+    commands.bindPipeline(vk::PipelineBindPoint::eCompute,
+      render.chunk_compute_pipeline(pipeline_layout, grid_shaders,
+        grid_shaders_len, "trace_main", voxel_count));
+    commands.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+      pipeline_layout, 0, *sets[frame_index], nullptr);
+    commands.pushConstants<glm::ivec4>(pipeline_layout, PUSH_STAGES,
+      offsetof(BindlessParams, grid), glm::ivec4(origin, size));
+    commands.dispatch((target.extent.width + TRACE_TILE - 1) / TRACE_TILE,
+      (target.extent.height + TRACE_TILE - 1) / TRACE_TILE, 1);
+  }
+  render.end_trace();
+}
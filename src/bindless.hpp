@@ -0,0 +1,140 @@
+#pragma once
+
+#include "allocator.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class Renderer;
+
+// what the bindless shaders know about each chunk, one per instance
+struct ChunkInfo {
+  // where the chunk's resources and transform are
+  uint32_t slot;
+};
+
+// where a chunk is, kept on the gpu at its slot for both ways of drawing
+struct ChunkTransform {
+  glm::mat4 model;
+  glm::mat4 model_inv;
+
+  // the box around the chunk's solid voxels in model space, which is what's
+  // rasterised and raymarched instead of the whole chunk. empty chunks have
+  // lo == hi
+  glm::vec4 lo;
+  glm::vec4 hi;
+};
+
+// an index into the descriptor arrays, handed back when the last reference
+// goes. pass it to Renderer::retire to keep it until the frames in flight
+// are done with it
+using BindlessSlot = std::shared_ptr<const uint32_t>;
+
+// draws every chunk with one indirect call. each chunk's image and buffers sit
+// in descriptor arrays at its slot, and its ChunkInfo is picked out of a
+// storage buffer by instance, so there's no per-chunk binding at all. which
+// chunks are drawn is decided on the gpu by a frustum culling compute pass
+class Bindless {
+public:
+  Bindless(vx::Renderer &render, uint32_t capacity);
+
+  BindlessSlot acquire();
+
+  // points a freshly acquired slot at a chunk's resources
+  void write(uint32_t slot, vk::ImageView voxels, vk::Buffer svo,
+    vk::Buffer palette, vk::Buffer bricks);
+
+  // transforms live in one device local buffer indexed by slot. setting one
+  // only marks it dirty, and flush copies whatever's dirty into the next
+  // frame, so a chunk that never moves is only written once
+  void set_transform(uint32_t slot, const ChunkTransform &transform);
+  void flush();
+  vk::Buffer transforms() { return transform_buffer; }
+
+  // records the culling pass over chunks, between Renderer::begin_frame and
+  // begin_rendering
+  void cull(const std::vector<ChunkInfo> &chunks);
+
+  // draws whatever the last cull kept, after Renderer::begin_rendering, with
+  // the pipeline for chunks voxel_count voxels across. leaves it bound
+  void draw(uint32_t voxel_count);
+
+  // draws every chunk in one full screen pass instead, which walks a grid of
+  // chunks size across from the chunk at origin and only marches through
+  // the ones it passes. cells are indexed [z][y][x], each a slot + 1 or 0
+  // for nothing there. after Renderer::begin_rendering, like draw
+  void draw_grid(uint32_t voxel_count, const std::vector<uint32_t> &cells,
+    glm::ivec3 origin, int size);
+
+  // the same as draw_grid but as a compute pass into the renderer's
+  // TraceTarget, composited in at Renderer::end_frame. between begin_frame
+  // and begin_rendering, like cull
+  void trace(uint32_t voxel_count, const std::vector<uint32_t> &cells,
+    glm::ivec3 origin, int size);
+
+  // builds cull's pipeline, and draw's, draw_grid's and trace's for chunks
+  // voxel_count voxels across, see Renderer::build_pipelines. cull can't
+  // be recorded before this
+  void build_pipelines(uint32_t voxel_count);
+
+private:
+  // threads per workgroup of cull_main in shader.slang
+  static const uint32_t CULL_GROUP = 64;
+
+  // pixels along each side of trace_main's workgroups
+  static const uint32_t TRACE_TILE = 8;
+
+  vx::Renderer &render;
+  uint32_t capacity;
+
+  vk::raii::DescriptorSetLayout layout = nullptr;
+  vk::raii::DescriptorPool pool = nullptr;
+  vk::raii::PipelineLayout pipeline_layout = nullptr;
+  vk::raii::Pipeline cull_pipeline = nullptr;
+
+  // one set per frame in flight, as they point at that frame's camera and
+  // chunk infos. the arrays in both are kept the same
+  std::vector<vk::raii::DescriptorSet> sets;
+
+  std::vector<vx::Allocation> info_mems;
+  std::vector<vk::raii::Buffer> info_buffers;
+  std::vector<ChunkInfo *> infos;
+
+  // what the culling pass writes: a VkDrawIndirectCommand per visible chunk,
+  // compacted to the front, and how many there are
+  std::vector<vx::Allocation> draw_mems;
+  std::vector<vk::raii::Buffer> draw_buffers;
+  std::vector<vx::Allocation> count_mems;
+  std::vector<vk::raii::Buffer> count_buffers;
+
+  // chunks passed to the last cull, the most draw could need
+  uint32_t culled = 0;
+
+  // each frame's chunk grid, grown whenever draw_grid is given a bigger one
+  std::vector<vx::Allocation> grid_mems;
+  std::vector<vk::raii::Buffer> grid_buffers;
+  std::vector<size_t> grid_capacity;
+
+  // the colour image each frame's set points trace_main at
+  std::vector<vk::ImageView> traced_views;
+
+  std::vector<uint32_t> free_slots;
+
+  vx::Allocation transform_mem = nullptr;
+  vk::raii::Buffer transform_buffer = nullptr;
+  std::vector<ChunkTransform> transforms_;
+  std::vector<uint32_t> dirty;
+
+  void create_layout();
+  void create_sets();
+  void create_grid(int frame_index, size_t cells);
+  void write_grid(int frame_index, const std::vector<uint32_t> &cells);
+};
+
+}
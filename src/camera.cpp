@@ -1,4 +1,5 @@
 #include "camera.hpp"
+#include "profiler.hpp"
 
 #include <cmath>
 #include <glm/ext/matrix_transform.hpp>
@@ -8,6 +9,7 @@
 using namespace vx;
 
 void Camera::update(float dt) {
+  ProfileZone zone("camera update");
   if (action & CameraAction::MoveFront) {
     pos.x -= speed * sin(yaw) * dt;
     pos.z -= speed * cos(yaw) * dt;
@@ -34,6 +36,11 @@ void Camera::update(float dt) {
   action = CameraAction::None;
 }
 
+glm::vec3 Camera::forward() const {
+  // the view looks down -direction, see uniforms
+  return -glm::vec3(cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw));
+}
+
 CameraUniforms Camera::uniforms(float width, float height) {
   // maths stolen from https://www.opengl-tutorial.org/beginners-tutorials/tutorial-6-keyboard-and-mouse/
   glm::vec3 direction(cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw));
@@ -53,6 +60,7 @@ CameraUniforms Camera::uniforms(float width, float height) {
     .tan_fov = static_cast<float>(tan(fov)),
     .z_near = z_near,
     .z_far = z_far,
-    .max_marches = max_marches
+    .max_marches = max_marches,
+    .traversal = static_cast<uint32_t>(traversal)
   };
 }
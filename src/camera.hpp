@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <glm/glm.hpp>
 
 namespace vx {
@@ -13,6 +14,13 @@ struct CameraUniforms {
   float z_near;
   float z_far;
   int max_marches;
+  uint32_t traversal;
+};
+
+// how the shader walks the voxels of a chunk
+enum class Traversal : uint32_t {
+  Dense = 0,
+  Octree = 1,
 };
 
 enum CameraAction : int {
@@ -59,16 +67,34 @@ public:
 
   void update(float dt);
 
+  // puts the camera exactly somewhere, for replaying a CameraPath
+  void set_pose(glm::vec3 pos, float yaw, float pitch) {
+    this->pos = pos;
+    this->yaw = yaw;
+    this->pitch = glm::clamp(pitch, -DEGREES_90, DEGREES_90);
+  }
+
+  glm::vec3 position() const { return pos; }
+  float yaw_angle() const { return yaw; }
+  float pitch_angle() const { return pitch; }
+  glm::vec3 forward() const;
+
+  void toggle_traversal() {
+    traversal = traversal == Traversal::Dense
+      ? Traversal::Octree
+      : Traversal::Dense;
+  }
+
   CameraUniforms uniforms(float width, float height);
 private:
   static constexpr float DEGREES_90  = glm::radians(90.);
   static constexpr float DEGREES_360 = glm::radians(360.);
 
   glm::vec3 pos = {0, 0, 0};
-  float pitch; // pitch is up-down
-  float yaw; // yaw is left-right
+  float pitch = 0; // pitch is up-down
+  float yaw = 0; // yaw is left-right
 
-  CameraAction action;
+  CameraAction action = CameraAction::None;
   float speed = 2.;
   glm::vec2 sensitivity = {0.005, 0.005};
 
@@ -76,6 +102,7 @@ private:
   float z_near = .1;
   float z_far = 100.;
   int max_marches = 80;
+  Traversal traversal = Traversal::Dense;
 };
 
 }
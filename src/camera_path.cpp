@@ -0,0 +1,101 @@
+#include "camera_path.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numbers>
+#include <sstream>
+#include <stdexcept>
+
+using namespace vx;
+
+CameraPath CameraPath::load(const std::string &file) {
+  std::ifstream in(file);
+  if (!in)
+    throw std::runtime_error("could not open camera path " + file);
+
+  CameraPath path;
+  std::string line;
+  for (int number = 1; std::getline(in, line); number++) {
+    // blank lines and # comments are skipped
+    auto start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    CameraKey key;
+    if (!(fields >> key.time >> key.pos.x >> key.pos.y >> key.pos.z >>
+        key.yaw >> key.pitch))
+      throw std::runtime_error(file + ":" + std::to_string(number) +
+        ": expected time x y z yaw pitch");
+    if (!path.keys.empty() && key.time < path.keys.back().time)
+      throw std::runtime_error(file + ":" + std::to_string(number) +
+        ": keyframes go back in time");
+    path.keys.push_back(key);
+  }
+
+  if (path.empty())
+    throw std::runtime_error("camera path " + file + " has no keyframes");
+  return path;
+}
+
+void CameraPath::save(const std::string &file) const {
+  std::ofstream out(file);
+  out << "# time x y z yaw pitch\n";
+  for (auto &key : keys) {
+    out << key.time << " " << key.pos.x << " " << key.pos.y << " " <<
+      key.pos.z << " " << key.yaw << " " << key.pitch << "\n";
+  }
+  if (!out.flush())
+    throw std::runtime_error("could not write camera path " + file);
+}
+
+CameraPath CameraPath::orbit(float radius, float height, float duration) {
+  // the camera looks down -forward, see Camera::uniforms, so a yaw of angle
+  // faces the origin from (sin, cos) * radius
+  const int KEYS = 64;
+  CameraPath path;
+  for (int i = 0; i <= KEYS; i++) {
+    float angle = 2 * std::numbers::pi_v<float> * i / KEYS;
+    path.add({
+      .time = duration * i / KEYS,
+      .pos = {radius * std::sin(angle), height, radius * std::cos(angle)},
+      .yaw = angle,
+      .pitch = std::atan2(height, radius)
+    });
+  }
+  return path;
+}
+
+void CameraPath::add(CameraKey key) {
+  keys.push_back(key);
+}
+
+CameraKey CameraPath::sample(float time) const {
+  if (keys.empty())
+    return { time, glm::vec3(0), 0, 0 };
+
+  auto next = std::upper_bound(keys.begin(), keys.end(), time,
+    [](float time, const CameraKey &key) { return time < key.time; });
+  if (next == keys.begin())
+    return keys.front();
+  if (next == keys.end())
+    return keys.back();
+
+  auto &a = *(next - 1);
+  auto &b = *next;
+  float t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 1;
+
+  // Camera::rotate wraps yaw, so recorded paths can jump by a whole turn
+  // between keys. go the short way round instead
+  const float TURN = 2 * std::numbers::pi_v<float>;
+  float yaw = b.yaw - a.yaw;
+  yaw -= TURN * std::round(yaw / TURN);
+
+  return {
+    .time = time,
+    .pos = glm::mix(a.pos, b.pos, t),
+    .yaw = a.yaw + yaw * t,
+    .pitch = glm::mix(a.pitch, b.pitch, t)
+  };
+}
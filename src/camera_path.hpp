@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vx {
+
+// where the camera is and which way it's looking some time into a path
+struct CameraKey {
+  float time;
+  glm::vec3 pos;
+  float yaw;
+  float pitch;
+};
+
+// keyframes for the camera to follow, interpolated linearly between. paths
+// are saved as plain text with one "time x y z yaw pitch" keyframe a line,
+// angles in radians, so they can be recorded from a session or written by
+// hand
+class CameraPath {
+public:
+  // throws if the file can't be read or a line doesn't parse
+  static CameraPath load(const std::string &file);
+  void save(const std::string &file) const;
+
+  // once around the origin, looking in at it from radius chunks away and
+  // height chunks up
+  static CameraPath orbit(float radius, float height, float duration);
+
+  // keys have to be added in time order
+  void add(CameraKey key);
+
+  CameraKey sample(float time) const;
+  float duration() const { return keys.empty() ? 0 : keys.back().time; }
+  bool empty() const { return keys.empty(); }
+
+private:
+  std::vector<CameraKey> keys;
+};
+
+}
@@ -1,103 +1,498 @@
 #include "chunk.hpp"
+#include "profiler.hpp"
 #include "vulkan/vulkan.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/matrix.hpp>
 
 using namespace vx;
 
-Chunk::Chunk(Renderer &render, int x, int y, int z)
-  : x_ (x)
-  , y_ (y)
-  , z_ (z)
-  , descriptor_sets (render.new_descriptor_set())
-  , uniforms (render) {
-  // generate a sphere
-  float radius_sq = (float) (COUNT - 1) / 2. * (float) (COUNT - 1) / 2.;
-  float c = (float) COUNT / 2.;
-
-  for (int i = 0; i < COUNT; i++) {
-    for (int j = 0; j < COUNT; j++) {
-      for (int k = 0; k < COUNT; k++) {
-        float i_ = (float) i;
-        float j_ = (float) j;
-        float k_ = (float) k;
-        float dist = (i_ - c) * (i_ - c) + (j_ - c) * (j_ - c) +
-          (k_ - c) * (k_ - c);
-        if (dist < radius_sq) {
-          if ((i + j + k) & 1)
-            voxels[i][j][k] = VoxelType::Light;
-          else voxels[i][j][k] = VoxelType::Dark;
-        } else voxels[i][j][k] = VoxelType::Empty;
-      }
-    }
-  }
+namespace {
 
-  for (int i = 0; i < COUNT; i++) {
-    for (int j = 0; j < COUNT; j++) {
-      if ((i + j) & 1)
-        voxels[i][0][j] = VoxelType::Light;
-      else voxels[i][0][j] = VoxelType::Dark;
-    }
-  }
+struct OldBuffer {
+  vx::Allocation mem;
+  vk::raii::Buffer buffer;
+};
 
-  // create image
-  render.device().create_image(image_, mem_, COUNT, COUNT, COUNT,
-    vk::Format::eR32Uint, vk::ImageTiling::eLinear,
-    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+struct OldImage {
+  vx::Allocation mem;
+  vk::raii::Image image;
+  vk::raii::ImageView view;
+};
+
+}
+
+// room to grow so small edits don't have to reallocate
+static size_t capacity(size_t size) {
+  return std::bit_ceil(std::max<size_t>(size, 64));
+}
+
+static void create_storage(Renderer &render, vk::raii::Buffer &buffer,
+  vx::Allocation &mem, size_t size) {
+  render.device().create_buffer(buffer, mem, size,
+    vk::BufferUsageFlagBits::eStorageBuffer |
+    vk::BufferUsageFlagBits::eTransferDst,
     vk::MemoryPropertyFlagBits::eDeviceLocal);
+}
+
+// hands a buffer we're replacing to the renderer, which frees it once the
+// frames in flight are done with it
+static void retire_buffer(Renderer &render, vk::raii::Buffer &buffer,
+  vx::Allocation &mem) {
+  render.retire(std::shared_ptr<OldBuffer>(new OldBuffer {
+    std::move(mem), std::move(buffer)
+  }));
+}
+
+template <int N>
+typename BasicChunk<N>::Data BasicChunk<N>::generate(
+  const TerrainGenerator &terrain, int x, int y, int z) {
+  ProfileZone zone("chunk generate");
+  std::vector<uint32_t> voxels(COUNT * COUNT * COUNT);
+  terrain.generate(x, y, z, COUNT, voxels.data());
+
+  // build the octree alongside the grid so the shader can use either
+  return {
+    .x = x, .y = y, .z = z,
+    .voxels = PalettedVoxels(voxels.data(), voxels.size()),
+    .octree = Octree(voxels.data(), COUNT)
+  };
+}
+
+template <int N>
+BasicChunk<N>::BasicChunk(Renderer &render, int x, int y, int z)
+  : BasicChunk(render, generate(SphereGenerator(), x, y, z)) { }
+
+template <int N>
+BasicChunk<N>::BasicChunk(Renderer &render, Data data)
+  : data_ (std::move(data))
+  , occupancy_ (data_.voxels, COUNT)
+  , descriptor_sets (render.new_descriptor_set()) {
+  ProfileZone zone("chunk upload");
+  // everything's uploaded in the background, and the first frame to draw
+  // the chunk waits for it on the gpu
+  auto &uploader = render.uploader();
+
+  // upload the octree
+  auto &nodes = data_.octree.nodes();
+  svo_capacity = capacity(nodes.size() * sizeof(nodes[0]));
+  create_storage(render, svo_buffer_, svo_mem_, svo_capacity);
+  uploader.buffer(svo_buffer_, 0, nodes.data(),
+    nodes.size() * sizeof(nodes[0]));
+
+  // upload the palette
+  auto &palette = data_.voxels.palette();
+  palette_capacity = capacity(palette.size() * sizeof(palette[0]));
+  create_storage(render, palette_buffer_, palette_mem_, palette_capacity);
+  uploader.buffer(palette_buffer_, 0, palette.data(),
+    palette.size() * sizeof(palette[0]));
+  uploaded_palette = palette.size();
+
+  // upload the brick occupancy masks, which are cheap enough to build here
+  // rather than on the worker
+  auto &bricks = occupancy_.bricks();
+  create_storage(render, bricks_buffer_, bricks_mem_,
+    bricks.size() * sizeof(bricks[0]));
+  uploader.buffer(bricks_buffer_, 0, bricks.data(),
+    bricks.size() * sizeof(bricks[0]));
 
   // copy voxels to image
-  render.pool().copy_to_image_staged(image_, voxels, COUNT, COUNT, COUNT, 4);
+  create_image(render);
+  auto indices = data_.voxels.gpu_indices();
+  uploader.image(image_, indices.data(), indices.size(),
+    {COUNT, COUNT, COUNT});
+
+  for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++)
+    write_descriptors(render, i);
+  write_slot(render);
+}
+
+template <int N>
+void BasicChunk<N>::create_image(Renderer &render) {
+  // the image holds palette indices, so it only needs to be as wide as the
+  // palette needs rather than a full 32 bits per voxel
+  format_ = data_.voxels.gpu_index_size() == 1 ? vk::Format::eR8Uint
+    : vk::Format::eR16Uint;
+
+  // optimal tiling lets the driver swizzle the image so the raymarch's
+  // scattered 3d reads share cache lines. linear is only kept to compare
+  // against, see Makefile
+#ifdef VX_LINEAR_CHUNK_IMAGES
+  auto tiling = vk::ImageTiling::eLinear;
+#else
+  auto tiling = vk::ImageTiling::eOptimal;
+#endif
+
+  // create image
+  render.device().create_image(image_, mem_, COUNT, COUNT, COUNT, format_,
+    tiling,
+    vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+    vk::MemoryPropertyFlagBits::eDeviceLocal);
 
   // create image view
   view_ = render.device().create_view(*image_, vk::ImageViewType::e3D,
-    vk::Format::eR32Uint, vk::ImageAspectFlagBits::eColor);
+    format_, vk::ImageAspectFlagBits::eColor);
+}
 
-  // put uniforms and image in descriptor
+template <int N>
+void BasicChunk<N>::write_descriptors(Renderer &render, int frame_index) {
+  // put transforms and image in descriptor. every chunk's transform is in
+  // the same buffer, picked out by push_slot
   vk::DescriptorImageInfo image_info {
     .imageView = view_,
     .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
   };
 
-  for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++) {
-    vk::DescriptorBufferInfo buffer_info {
-      .buffer = uniforms.ubo(i),
-      .offset = 0,
-      .range = sizeof(ChunkUniforms)
-    };
-
-    std::array write_sets {
-      vk::WriteDescriptorSet {
-        .dstSet = descriptor_sets[i],
-        .dstBinding = 1,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = vk::DescriptorType::eUniformBuffer,
-        .pBufferInfo = &buffer_info
-      },
-      vk::WriteDescriptorSet {
-        .dstSet = descriptor_sets[i],
-        .dstBinding = 2,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = vk::DescriptorType::eSampledImage,
-        .pImageInfo = &image_info
-      },
-    };
-
-    render.device().device().updateDescriptorSets(write_sets, {});
-  }
+  vk::DescriptorBufferInfo buffer_info {
+    .buffer = render.bindless().transforms(),
+    .offset = 0,
+    .range = vk::WholeSize
+  };
+
+  vk::DescriptorBufferInfo svo_info {
+    .buffer = svo_buffer_,
+    .offset = 0,
+    .range = vk::WholeSize
+  };
+
+  vk::DescriptorBufferInfo palette_info {
+    .buffer = palette_buffer_,
+    .offset = 0,
+    .range = vk::WholeSize
+  };
+
+  vk::DescriptorBufferInfo bricks_info {
+    .buffer = bricks_buffer_,
+    .offset = 0,
+    .range = vk::WholeSize
+  };
+
+  auto &set = descriptor_sets[frame_index];
+  std::array write_sets {
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 1,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .pBufferInfo = &buffer_info
+    },
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 2,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .pImageInfo = &image_info
+    },
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 3,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .pBufferInfo = &svo_info
+    },
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 4,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .pBufferInfo = &palette_info
+    },
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 5,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .pBufferInfo = &bricks_info
+    },
+  };
+
+  render.device().device().updateDescriptorSets(write_sets, {});
+  stale[frame_index] = false;
+}
+
+static glm::mat4 model_matrix(int size, int x, int y, int z) {
+  glm::mat4 model = glm::scale(glm::mat4(1.), {size, size, size});
+  return glm::translate(model, {x, y, z});
 }
 
-void Chunk::render(vx::Renderer &render) {
-  glm::mat4 model = glm::scale(glm::mat4(1.), {SIZE, SIZE, SIZE});
-  model = glm::translate(model, {x_, y_, z_});
-  uniforms.upload(render.swapchain().frame_index(), {
+template <int N>
+void BasicChunk<N>::write_slot(Renderer &render) {
+  // slots still in use by frames in flight can't be rewritten, so moving to
+  // new resources means moving to a new slot
+  if (slot)
+    render.retire(std::move(slot));
+  slot = render.bindless().acquire();
+  render.bindless().write(*slot, view_, svo_buffer_, palette_buffer_,
+    bricks_buffer_);
+
+  // the transform goes with the slot
+  write_transform(render);
+}
+
+template <int N>
+void BasicChunk<N>::write_transform(Renderer &render) {
+  // chunks never move, but the box around what's solid in them changes with
+  // every edit
+  glm::mat4 model = model_matrix(SIZE, data_.x, data_.y, data_.z);
+  Octree::Bounds bounds = data_.octree.bounds();
+  float scale = 1.f / COUNT;
+  render.bindless().set_transform(*slot, {
     .model = model,
     .model_inv = glm::inverse(model),
-    .voxel_count = COUNT
+    .lo = glm::vec4(bounds.lo[0], bounds.lo[1], bounds.lo[2], 0) * scale,
+    .hi = glm::vec4(bounds.hi[0], bounds.hi[1], bounds.hi[2], 0) * scale
+  });
+}
+
+template <int N>
+ChunkInfo BasicChunk<N>::info() {
+  return { .slot = *slot };
+}
+
+template <int N>
+void BasicChunk<N>::render(vx::Renderer &render) {
+  this->render(render, render.command_buffer());
+}
+
+template <int N>
+void BasicChunk<N>::render(vx::Renderer &render,
+  vk::raii::CommandBuffer &commands) {
+  int frame_index = render.swapchain().frame_index();
+
+  // the frame that last used this set is done, so it's safe to repoint
+  if (stale[frame_index])
+    write_descriptors(render, frame_index);
+
+  // nothing to hit, so nothing to rasterise
+  if (empty())
+    return;
+
+  render.bind_descriptor(commands, descriptor_sets);
+  render.push_slot(commands, *slot);
+  commands.draw(36, 1, 0, 0);
+}
+
+template <int N>
+void BasicChunk<N>::set_voxel(glm::ivec3 pos, uint32_t voxel) {
+  fill_box(pos, pos + 1, voxel);
+}
+
+template <int N>
+void BasicChunk<N>::fill_box(glm::ivec3 lo, glm::ivec3 hi, uint32_t voxel) {
+  fill({lo, hi}, voxel, [](glm::ivec3) { return true; });
+}
+
+template <int N>
+void BasicChunk<N>::fill_sphere(glm::vec3 centre, float radius,
+  uint32_t voxel) {
+  Box box {
+    glm::ivec3(glm::floor(centre - radius)),
+    glm::ivec3(glm::ceil(centre + radius))
+  };
+
+  // a voxel is inside if its centre is
+  fill(box, voxel, [&](glm::ivec3 pos) {
+    glm::vec3 d = glm::vec3(pos) + .5f - centre;
+    return glm::dot(d, d) <= radius * radius;
   });
+}
+
+template <int N>
+void BasicChunk<N>::fill(Box box, uint32_t voxel,
+  const std::function<bool(glm::ivec3)> &inside) {
+  box.lo = glm::max(box.lo, glm::ivec3(0));
+  box.hi = glm::min(box.hi, glm::ivec3(COUNT));
+
+  // only the voxels that actually change need uploading
+  Box changed { glm::ivec3(COUNT), glm::ivec3(0) };
+  for (int z = box.lo.z; z < box.hi.z; z++) {
+    for (int y = box.lo.y; y < box.hi.y; y++) {
+      for (int x = box.lo.x; x < box.hi.x; x++) {
+        glm::ivec3 pos(x, y, z);
+        size_t i = (z * COUNT + y) * COUNT + x;
+        if (!inside(pos) || data_.voxels.get(i) == voxel)
+          continue;
+
+        data_.voxels.set(i, voxel);
+        occupancy_.set(x, y, z, voxel != VoxelType::Empty);
+        changed.lo = glm::min(changed.lo, pos);
+        changed.hi = glm::max(changed.hi, pos + 1);
+      }
+    }
+  }
+
+  if (changed.lo.x < changed.hi.x)
+    mark_dirty(changed);
+}
+
+template <int N>
+void BasicChunk<N>::mark_dirty(Box box) {
+  // fold in any box this one touches, so repeated edits in one spot stay a
+  // single copy
+  for (auto it = dirty.begin(); it != dirty.end();) {
+    if (glm::all(glm::lessThanEqual(it->lo, box.hi)) &&
+        glm::all(glm::lessThanEqual(box.lo, it->hi))) {
+      box.lo = glm::min(box.lo, it->lo);
+      box.hi = glm::max(box.hi, it->hi);
+      it = dirty.erase(it);
+    } else it++;
+  }
+  dirty.push_back(box);
+
+  if (dirty.size() > MAX_DIRTY) {
+    for (auto &other : dirty) {
+      box.lo = glm::min(box.lo, other.lo);
+      box.hi = glm::max(box.hi, other.hi);
+    }
+    dirty = { box };
+  }
+}
+
+template <int N>
+void BasicChunk<N>::flush(Renderer &render) {
+  if (dirty.empty())
+    return;
+
+  // the octree is only a few kilobytes, so rebuild and upload it whole
+  std::vector<uint32_t> voxels(COUNT * COUNT * COUNT);
+  for (size_t i = 0; i < voxels.size(); i++)
+    voxels[i] = data_.voxels.get(i);
+  data_.octree = Octree(voxels.data(), COUNT);
+
+  // anything that has outgrown its allocation gets a new one, and the
+  // descriptor sets are repointed at it as their frames come around
+  bool replaced = false;
+  auto &nodes = data_.octree.nodes();
+  size_t svo_size = nodes.size() * sizeof(nodes[0]);
+  if (svo_size > svo_capacity) {
+    retire_buffer(render, svo_buffer_, svo_mem_);
+    svo_capacity = capacity(svo_size);
+    create_storage(render, svo_buffer_, svo_mem_, svo_capacity);
+    stale.fill(true);
+    replaced = true;
+  }
+
+  auto &palette = data_.voxels.palette();
+  size_t palette_size = palette.size() * sizeof(palette[0]);
+  if (palette_size > palette_capacity) {
+    retire_buffer(render, palette_buffer_, palette_mem_);
+    palette_capacity = capacity(palette_size);
+    create_storage(render, palette_buffer_, palette_mem_, palette_capacity);
+    uploaded_palette = 0;
+    stale.fill(true);
+    replaced = true;
+  }
+
+  // widening the palette past 8 bits changes the image format, so the whole
+  // image has to be replaced
+  bool new_image = format_ != (data_.voxels.gpu_index_size() == 1
+    ? vk::Format::eR8Uint : vk::Format::eR16Uint);
+  if (new_image) {
+    render.retire(std::shared_ptr<OldImage>(new OldImage {
+      std::move(mem_), std::move(image_), std::move(view_)
+    }));
+    create_image(render);
+    dirty = { Box { glm::ivec3(0), glm::ivec3(COUNT) } };
+    stale.fill(true);
+    replaced = true;
+  }
+
+  // everything goes through the uploader's ring. what was kept from before
+  // may still be read by frames in flight, so the copies wait for them on
+  // the gpu, and the next frame waits for the copies
+  auto &uploader = render.uploader();
+  uploader.after(render.frames_done(), render.frames_submitted());
+  uploader.buffer(svo_buffer_, 0, nodes.data(), svo_size);
+
+  // palettes only ever grow, so just send the new entries
+  if (palette.size() > uploaded_palette) {
+    size_t offset = uploaded_palette * sizeof(palette[0]);
+    uploader.buffer(palette_buffer_, offset, &palette[uploaded_palette],
+      palette_size - offset);
+    uploaded_palette = palette.size();
+  }
+
+  // the bricks under the dirty boxes, as one contiguous range
+  auto &bricks = occupancy_.bricks();
+  int n = occupancy_.count();
+  size_t first = bricks.size();
+  size_t last = 0;
+  for (auto &box : dirty) {
+    glm::ivec3 lo = box.lo / Occupancy::BRICK;
+    glm::ivec3 hi = (box.hi - 1) / Occupancy::BRICK;
+    first = std::min<size_t>(first, (lo.z * n + lo.y) * n + lo.x);
+    last = std::max<size_t>(last, (hi.z * n + hi.y) * n + hi.x);
+  }
+  uploader.buffer(bricks_buffer_, first * sizeof(bricks[0]), &bricks[first],
+    (last - first + 1) * sizeof(bricks[0]));
+
+  // a new image is filled whole, like a new chunk's
+  if (new_image) {
+    auto indices = data_.voxels.gpu_indices();
+    uploader.image(image_, indices.data(), indices.size(),
+      {COUNT, COUNT, COUNT});
+  } else {
+    // and otherwise the voxels in each dirty box, packed tightly one after
+    // the other
+    size_t index_size = data_.voxels.gpu_index_size();
+    std::vector<uint8_t> bytes;
+    std::vector<vk::BufferImageCopy> image_copies;
+    for (auto &box : dirty) {
+      glm::ivec3 size = box.hi - box.lo;
+      size_t offset = bytes.size();
+      bytes.resize(offset +
+        ((size.x * size.y * size.z * index_size + 3) & ~size_t(3)));
+      size_t i = 0;
+      for (int z = box.lo.z; z < box.hi.z; z++) {
+        for (int y = box.lo.y; y < box.hi.y; y++) {
+          for (int x = box.lo.x; x < box.hi.x; x++, i++) {
+            uint32_t index = data_.voxels.index((z * COUNT + y) * COUNT + x);
+            if (index_size == 1) {
+              bytes[offset + i] = index;
+            } else {
+              uint16_t wide = index;
+              std::memcpy(&bytes[offset + i * 2], &wide, 2);
+            }
+          }
+        }
+      }
+
+      image_copies.push_back({
+        .bufferOffset = offset,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+        .imageOffset = { box.lo.x, box.lo.y, box.lo.z },
+        .imageExtent = {
+          static_cast<uint32_t>(size.x),
+          static_cast<uint32_t>(size.y),
+          static_cast<uint32_t>(size.z)
+        }
+      });
+    }
+    uploader.image(image_, bytes.data(), bytes.size(),
+      std::move(image_copies));
+  }
+  dirty.clear();
+
+  // a new slot gets the new bounds with it
+  if (replaced)
+    write_slot(render);
+  else write_transform(render);
+}
+
+namespace vx {
+
+template class BasicChunk<8>;
+template class BasicChunk<16>;
+template class BasicChunk<32>;
+template class BasicChunk<64>;
 
-  render.bind_descriptor(descriptor_sets);
-  render.command_buffer().draw(36, 1, 0, 0);
 }
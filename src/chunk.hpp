@@ -1,46 +1,132 @@
 #pragma once
 
+#include "occupancy.hpp"
+#include "octree.hpp"
+#include "palette.hpp"
 #include "renderer.hpp"
+#include "terrain.hpp"
 
+#include <array>
 #include <cstdint>
+#include <functional>
 #include <vulkan/vulkan_raii.hpp>
 
 namespace vx {
 
-enum VoxelType : uint32_t {
-  Empty = 0,
-  Light = 1,
-  Dark = 2,
-};
-
-struct ChunkUniforms {
-  glm::mat4 model;
-  glm::mat4 model_inv;
-  uint32_t voxel_count;
-};
+// voxels along each edge of a chunk in this build, see Makefile
+#ifndef VX_CHUNK_COUNT
+#define VX_CHUNK_COUNT 8
+#endif
 
-class Chunk {
+// a chunk N voxels across. N is a template parameter so every loop over a
+// chunk is compiled for its size, as the shader is through
+// Renderer::chunk_pipeline. chunk.cpp instantiates 8, 16, 32 and 64
+template <int N>
+class BasicChunk {
 public:
-  Chunk(Renderer &render, int x, int y, int z);
+  static_assert(N >= Occupancy::BRICK && (N & (N - 1)) == 0,
+    "chunks must be a power of two at least a brick across");
 
+  // world units along each edge, whatever the voxel count
   static const int SIZE = 1;
-  static const int COUNT = 8;
+  static const int COUNT = N;
+
+  // everything about a chunk that doesn't touch the gpu, so it can be
+  // generated on a worker thread and handed to the main thread to upload
+  struct Data {
+    int x, y, z;
+
+    // indexed x fastest, then y, then z
+    PalettedVoxels voxels;
+    Octree octree;
+  };
+
+  static Data generate(const TerrainGenerator &terrain, int x, int y, int z);
+
+  // a chunk from SphereGenerator
+  BasicChunk(Renderer &render, int x, int y, int z);
+  BasicChunk(Renderer &render, Data data);
 
   void render(vx::Renderer &render);
 
-  int x() { return x_; }
-  int y() { return y_; }
-  int z() { return z_; }
+  // records the draw into commands rather than the frame's own, for
+  // Renderer::draw_parallel. touches nothing shared with other chunks, so
+  // different chunks can be rendered on different threads at once
+  void render(vx::Renderer &render, vk::raii::CommandBuffer &commands);
+
+  // for drawing through Bindless instead of render
+  ChunkInfo info();
+
+  // edits in voxel coordinates local to the chunk, clipped to it. they only
+  // change the cpu copy and mark what changed as dirty until flush
+  void set_voxel(glm::ivec3 pos, uint32_t voxel);
+  void fill_box(glm::ivec3 lo, glm::ivec3 hi, uint32_t voxel);
+  void fill_sphere(glm::vec3 centre, float radius, uint32_t voxel);
+
+  // uploads just the dirty parts of the chunk, in time for the next frame
+  void flush(vx::Renderer &render);
+
+  // as of the last flush
+  const Octree &octree() const { return data_.octree; }
+  bool empty() const { return data_.octree.nodes()[0] == 0; }
+
+  int x() { return data_.x; }
+  int y() { return data_.y; }
+  int z() { return data_.z; }
 
 private:
-  int x_, y_, z_;
-  uint32_t voxels[COUNT][COUNT][COUNT];
+  // a half open box of voxels
+  struct Box {
+    glm::ivec3 lo;
+    glm::ivec3 hi;
+  };
+
+  // past this many separate dirty boxes we just upload their bounds
+  static const size_t MAX_DIRTY = 8;
+
+  Data data_;
+  Occupancy occupancy_;
+  std::vector<Box> dirty;
+
+  // palette entries the gpu copy already has
+  size_t uploaded_palette = 0;
 
-  std::vector<vk::raii::DescriptorSet> descriptor_sets;
-  UniformBuffer<ChunkUniforms> uniforms;
+  // buffers are allocated with room to grow, so most edits can be copied
+  // straight into them
+  size_t svo_capacity = 0;
+  size_t palette_capacity = 0;
+
+  // descriptor sets that still point at buffers or an image we've since
+  // replaced, rewritten when their frame comes around again
+  std::array<bool, Swapchain::MAX_FRAMES_IN_FLIGHT> stale {};
+
+  std::vector<vx::DescriptorSet> descriptor_sets;
+  BindlessSlot slot;
+  vx::Allocation mem_ = nullptr;
   vk::raii::Image image_ = nullptr;
-  vk::raii::DeviceMemory mem_ = nullptr;
   vk::raii::ImageView view_ = nullptr;
+  vx::Allocation svo_mem_ = nullptr;
+  vk::raii::Buffer svo_buffer_ = nullptr;
+  vx::Allocation palette_mem_ = nullptr;
+  vk::raii::Buffer palette_buffer_ = nullptr;
+  vx::Allocation bricks_mem_ = nullptr;
+  vk::raii::Buffer bricks_buffer_ = nullptr;
+  vk::Format format_ = vk::Format::eUndefined;
+
+  void create_image(vx::Renderer &render);
+  void write_descriptors(vx::Renderer &render, int frame_index);
+  void write_slot(vx::Renderer &render);
+  void write_transform(vx::Renderer &render);
+  void fill(Box box, uint32_t voxel,
+    const std::function<bool(glm::ivec3)> &inside);
+  void mark_dirty(Box box);
 };
 
+extern template class BasicChunk<8>;
+extern template class BasicChunk<16>;
+extern template class BasicChunk<32>;
+extern template class BasicChunk<64>;
+
+using Chunk = BasicChunk<VX_CHUNK_COUNT>;
+
 }
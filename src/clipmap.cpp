@@ -0,0 +1,322 @@
+#include "clipmap.hpp"
+#include "jobs.hpp"
+#include "profiler.hpp"
+#include "renderer.hpp"
+#include "shaders.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+using namespace vx;
+
+namespace {
+
+struct Staging {
+  vx::Allocation mem = nullptr;
+  vk::raii::Buffer buffer = nullptr;
+};
+
+}
+
+static int floor_div(int a, int b) {
+  return a / b - (a % b < 0);
+}
+
+static glm::ivec3 floor_div(glm::ivec3 a, int b) {
+  return { floor_div(a.x, b), floor_div(a.y, b), floor_div(a.z, b) };
+}
+
+static int wrap(int cell) {
+  return ((cell % Clipmap::SIZE) + Clipmap::SIZE) % Clipmap::SIZE;
+}
+
+Clipmap::Clipmap(Renderer &render, int voxel_count)
+  : voxel_count (voxel_count) {
+  // a cell of the coarsest level has to fit inside one chunk, so filling it
+  // only ever reads one octree
+  if (voxel_count < 1 << (LEVELS - 1))
+    throw std::invalid_argument("chunks too small for the clipmap's levels");
+
+  for (auto &level : levels) {
+    render.device().create_image(level.image, level.mem, SIZE, SIZE, SIZE,
+      vk::Format::eR8Uint, vk::ImageTiling::eOptimal,
+      vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+      vk::MemoryPropertyFlagBits::eDeviceLocal);
+    level.view = render.device().create_view(*level.image,
+      vk::ImageViewType::e3D, vk::Format::eR8Uint,
+      vk::ImageAspectFlagBits::eColor);
+  }
+}
+
+void Clipmap::write_set(Renderer &render, vk::DescriptorSet set,
+  int frame_index) {
+  std::array<vk::DescriptorImageInfo, LEVELS> image_infos;
+  for (int i = 0; i < LEVELS; i++) {
+    image_infos[i] = {
+      .imageView = levels[i].view,
+      .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+  }
+
+  vk::DescriptorBufferInfo camera_info {
+    .buffer = render.camera_ubo(frame_index),
+    .offset = 0,
+    .range = sizeof(CameraUniforms)
+  };
+
+  std::array write_sets {
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 0,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eUniformBuffer,
+      .pBufferInfo = &camera_info
+    },
+    vk::WriteDescriptorSet {
+      .dstSet = set,
+      .dstBinding = 1,
+      .dstArrayElement = 0,
+      .descriptorCount = LEVELS,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .pImageInfo = image_infos.data()
+    }
+  };
+
+  render.device().device().updateDescriptorSets(write_sets, {});
+}
+
+void Clipmap::invalidate(glm::ivec3 lo, glm::ivec3 hi) {
+  stale.push_back({ lo, hi });
+}
+
+void Clipmap::reset() {
+  fresh = true;
+  stale.clear();
+}
+
+void Clipmap::update(Renderer &render, JobSystem &jobs, glm::vec3 camera,
+  const Lookup &lookup) {
+  ProfileZone zone("clipmap update");
+  glm::vec3 voxel = camera * static_cast<float>(voxel_count);
+
+  // the boxes of cells to fill in at each level
+  std::array<std::vector<Box>, LEVELS> regions;
+  for (int i = 0; i < LEVELS; i++) {
+    auto &level = levels[i];
+    int cell = 1 << i;
+    glm::ivec3 centre(glm::floor(voxel / static_cast<float>(cell)));
+    glm::ivec3 origin = floor_div(centre, STEP) * STEP - SIZE / 2;
+
+    auto &boxes = regions[i];
+    glm::ivec3 moved = glm::abs(origin - level.origin);
+    if (fresh || glm::any(glm::greaterThanEqual(moved, glm::ivec3(SIZE)))) {
+      boxes.push_back({ origin, origin + SIZE });
+    } else {
+      // the slab the window swept over along each axis it moved. where they
+      // overlap in the corners gets filled twice, which is cheaper than
+      // carving them apart
+      for (int axis = 0; axis < 3; axis++) {
+        int from = level.origin[axis];
+        int to = origin[axis];
+        if (from == to)
+          continue;
+        Box slab { origin, origin + SIZE };
+        if (to > from)
+          slab.lo[axis] = from + SIZE;
+        else slab.hi[axis] = from;
+        boxes.push_back(slab);
+      }
+    }
+    level.origin = origin;
+
+    // and the cells of this level covering anything invalidated, where
+    // they're in the window
+    for (auto &box : stale) {
+      Box cells {
+        glm::max(floor_div(box.lo, cell), origin),
+        glm::min(floor_div(box.hi - 1, cell) + 1, origin + SIZE)
+      };
+      if (glm::all(glm::lessThan(cells.lo, cells.hi)))
+        boxes.push_back(cells);
+    }
+  }
+  stale.clear();
+
+  // every box is split where it wraps around the texture, and each piece
+  // gets its own range of one staging buffer
+  struct Piece {
+    int level;
+    Box box;
+    size_t offset;
+  };
+  std::vector<Piece> filling;
+  size_t total = 0;
+  std::array<std::vector<vk::BufferImageCopy>, LEVELS> copies;
+  for (int i = 0; i < LEVELS; i++) {
+    for (auto &box : regions[i]) {
+      std::vector<Box> pieces { box };
+      for (int axis = 0; axis < 3; axis++) {
+        for (size_t j = 0, n = pieces.size(); j < n; j++) {
+          Box &piece = pieces[j];
+          int edge = piece.lo[axis] - wrap(piece.lo[axis]) + SIZE;
+          if (piece.hi[axis] <= edge)
+            continue;
+          Box upper = piece;
+          upper.lo[axis] = edge;
+          piece.hi[axis] = edge;
+          pieces.push_back(upper);
+        }
+      }
+
+      for (auto &piece : pieces) {
+        glm::ivec3 size = piece.hi - piece.lo;
+        size_t offset = total;
+        total = (offset + size.x * size.y * size.z + 3) & ~size_t(3);
+        filling.push_back({ i, piece, offset });
+
+        copies[i].push_back({
+          .bufferOffset = offset,
+          .bufferRowLength = 0,
+          .bufferImageHeight = 0,
+          .imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+          .imageOffset = {
+            wrap(piece.lo.x), wrap(piece.lo.y), wrap(piece.lo.z)
+          },
+          .imageExtent = {
+            static_cast<uint32_t>(size.x),
+            static_cast<uint32_t>(size.y),
+            static_cast<uint32_t>(size.z)
+          }
+        });
+      }
+    }
+  }
+
+  if (filling.empty())
+    return;
+
+  // a fresh window is millions of cells, far too many for one thread in one
+  // frame. pieces are cut into slabs of a few layers, each filling its own
+  // bytes, and spread over the workers. chunks only change on this thread,
+  // which is waiting, so the lookups are safe
+  std::vector<uint8_t> bytes(total);
+  std::vector<Job> filled;
+  for (auto &piece : filling) {
+    glm::ivec3 size = piece.box.hi - piece.box.lo;
+    size_t layer = size_t(size.x) * size.y;
+    for (int z = piece.box.lo.z; z < piece.box.hi.z; z += FILL_LAYERS) {
+      Box slab = piece.box;
+      slab.lo.z = z;
+      slab.hi.z = std::min(z + FILL_LAYERS, piece.box.hi.z);
+      uint8_t *out = &bytes[piece.offset + (z - piece.box.lo.z) * layer];
+      filled.push_back(jobs.spawn([this, &lookup, level = piece.level, slab,
+        out] {
+        ProfileZone zone("clipmap fill");
+        fill(level, slab, lookup, out);
+      }));
+    }
+  }
+  jobs.wait(jobs.spawn([] { }, filled));
+
+  auto staging = std::make_shared<Staging>();
+  render.device().create_buffer(staging->buffer, staging->mem, bytes.size(),
+    vk::BufferUsageFlagBits::eTransferSrc,
+    vk::MemoryPropertyFlagBits::eHostVisible |
+    vk::MemoryPropertyFlagBits::eHostCoherent);
+  std::memcpy(staging->mem.mapped(), bytes.data(), bytes.size());
+
+  std::array<vk::Image, LEVELS> images;
+  for (int i = 0; i < LEVELS; i++)
+    images[i] = levels[i].image;
+
+  // the first update fills every window whole, so nothing that came before
+  // needs keeping
+  render.upload([&render, src = *staging->buffer, images, copies,
+    fresh = fresh](vk::raii::CommandBuffer &commands) {
+    for (int i = 0; i < LEVELS; i++) {
+      if (copies[i].empty())
+        continue;
+      render.transition_image_layout(commands, images[i],
+        fresh ? vk::ImageLayout::eUndefined
+          : vk::ImageLayout::eShaderReadOnlyOptimal,
+        vk::ImageLayout::eTransferDstOptimal,
+        {},
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::PipelineStageFlagBits2::eFragmentShader,
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::ImageAspectFlagBits::eColor);
+      commands.copyBufferToImage(src, images[i],
+        vk::ImageLayout::eTransferDstOptimal, copies[i]);
+      render.transition_image_layout(commands, images[i],
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::AccessFlagBits2::eShaderRead,
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::PipelineStageFlagBits2::eFragmentShader,
+        vk::ImageAspectFlagBits::eColor);
+    }
+  });
+  render.retire(staging);
+  fresh = false;
+}
+
+void Clipmap::fill(int level, Box box, const Lookup &lookup,
+  uint8_t *out) const {
+  // cells never straddle chunks, so each row only looks up the chunks it
+  // crosses
+  int cell = 1 << level;
+  int per_chunk = voxel_count / cell;
+  size_t i = 0;
+  for (int z = box.lo.z; z < box.hi.z; z++) {
+    for (int y = box.lo.y; y < box.hi.y; y++) {
+      const Octree *octree = nullptr;
+      int chunk_x = INT_MIN;
+      int chunk_y = floor_div(y, per_chunk);
+      int chunk_z = floor_div(z, per_chunk);
+      for (int x = box.lo.x; x < box.hi.x; x++, i++) {
+        if (floor_div(x, per_chunk) != chunk_x) {
+          chunk_x = floor_div(x, per_chunk);
+          octree = lookup({ chunk_x, chunk_y, chunk_z });
+        }
+
+        uint32_t voxel = 0;
+        if (octree) {
+          voxel = octree->at((x - chunk_x * per_chunk) * cell,
+            (y - chunk_y * per_chunk) * cell,
+            (z - chunk_z * per_chunk) * cell, cell);
+        }
+
+        // voxel types all fit in a byte
+        out[i] = std::min<uint32_t>(voxel, UINT8_MAX);
+      }
+    }
+  }
+}
+
+void Clipmap::draw(Renderer &render) {
+  int frame_index = render.swapchain().frame_index();
+  auto set = render.descriptors().allocate_transient(frame_index,
+    *render.clipmap_layout());
+  write_set(render, set, frame_index);
+
+  auto &commands = render.command_buffer();
+  auto &pipeline_layout = render.clipmap_pipeline_layout();
+  commands.bindPipeline(vk::PipelineBindPoint::eGraphics,
+    render.chunk_pipeline(pipeline_layout, clipmap_shaders,
+      clipmap_shaders_len, voxel_count));
+  commands.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+    pipeline_layout, 0, set, nullptr);
+
+  std::array<glm::ivec4, LEVELS> origins;
+  for (int i = 0; i < LEVELS; i++)
+    origins[i] = glm::ivec4(levels[i].origin, 0);
+  commands.pushConstants<glm::ivec4>(pipeline_layout,
+    vk::ShaderStageFlagBits::eFragment, 0, origins);
+
+  // one triangle covering the screen, see vert_main in shader.slang
+  commands.draw(3, 1, 0, 0);
+}
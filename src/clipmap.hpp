@@ -0,0 +1,96 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "octree.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class JobSystem;
+class Renderer;
+
+// the voxel types around the camera in a few nested 3d textures, each level
+// covering twice the distance of the one inside it at half the detail, so the
+// whole view can be raymarched as one volume in one full screen pass however
+// many chunks are loaded. every level is the same fixed size and addressed
+// toroidally, cell c at texel c mod SIZE, so when the camera moves only the
+// slabs coming into view are filled in and uploaded, over the ones leaving
+class Clipmap {
+public:
+  // must match CLIP_LEVELS and CLIP_SIZE in shader.slang
+  static const int LEVELS = 3;
+  static const int SIZE = 128;
+
+  // windows move this many cells at a time, so a camera wandering about
+  // doesn't upload a sliver every frame
+  static const int STEP = 8;
+
+  // layers of cells filled by each job in update
+  static const int FILL_LAYERS = 8;
+
+  // the octree of the chunk at a chunk position, or null if it isn't loaded
+  using Lookup = std::function<const vx::Octree *(glm::ivec3)>;
+
+  // for chunks voxel_count voxels across, each one world unit wide
+  Clipmap(vx::Renderer &render, int voxel_count);
+
+  Clipmap(const Clipmap &that) = delete;
+  Clipmap &operator=(const Clipmap &that) = delete;
+
+  // marks a half open box of world voxels as changed, so whatever of it is
+  // in a window is read again at the next update
+  void invalidate(glm::ivec3 lo, glm::ivec3 hi);
+
+  // forgets everything uploaded, so the next update fills every window whole
+  void reset();
+
+  // recentres the windows on camera, in world units, and queues uploads of
+  // whatever came into view or was invalidated since the last update. the
+  // cells are filled on jobs, so lookup has to be safe to call from any
+  // thread while this waits
+  void update(vx::Renderer &render, vx::JobSystem &jobs, glm::vec3 camera,
+    const Lookup &lookup);
+
+  // after Renderer::begin_rendering. leaves the pipeline bound
+  void draw(vx::Renderer &render);
+
+private:
+  // a half open box of cells
+  struct Box {
+    glm::ivec3 lo;
+    glm::ivec3 hi;
+  };
+
+  struct Level {
+    vx::Allocation mem = nullptr;
+    vk::raii::Image image = nullptr;
+    vk::raii::ImageView view = nullptr;
+
+    // the cell at the window's low corner, in cells of this level
+    glm::ivec3 origin {0};
+  };
+
+  int voxel_count;
+  std::array<Level, LEVELS> levels;
+
+  // nothing's been uploaded yet, so every window is filled whole
+  bool fresh = true;
+
+  // world voxels changed since the last update
+  std::vector<Box> stale;
+
+  // points a transient set from draw at the levels and frame_index's camera
+  void write_set(vx::Renderer &render, vk::DescriptorSet set,
+    int frame_index);
+  void fill(int level, Box box, const Lookup &lookup, uint8_t *out) const;
+};
+
+}
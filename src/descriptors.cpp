@@ -0,0 +1,103 @@
+#include "descriptors.hpp"
+
+#include <stdexcept>
+
+using namespace vx;
+
+void DescriptorSet::release() {
+  if (allocator)
+    allocator->give(*this);
+  allocator = nullptr;
+  set = nullptr;
+}
+
+void DescriptorSet::swap(DescriptorSet &that) noexcept {
+  std::swap(allocator, that.allocator);
+  std::swap(layout, that.layout);
+  std::swap(set, that.set);
+}
+
+DescriptorAllocator::DescriptorAllocator(vk::raii::Device &device,
+  std::vector<vk::DescriptorPoolSize> per_set, uint32_t in_flight)
+  : device (device)
+  , pool_sizes (std::move(per_set))
+  , transient (in_flight) {
+  for (auto &size : pool_sizes)
+    size.descriptorCount *= SETS_PER_POOL;
+}
+
+vk::DescriptorSet DescriptorAllocator::take(Chain &chain,
+  vk::DescriptorSetLayout layout) {
+  while (true) {
+    bool fresh = chain.current == chain.pools.size();
+    if (fresh) {
+      chain.pools.emplace_back(device, vk::DescriptorPoolCreateInfo {
+        .maxSets = SETS_PER_POOL,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes = pool_sizes.data()
+      });
+      stats_.pools++;
+    }
+
+    // sets are never freed back to their pool, so there's no need for the
+    // raii wrapper to do it
+    try {
+      auto sets = device.allocateDescriptorSets({
+        .descriptorPool = *chain.pools[chain.current],
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout
+      });
+      return sets.front().release();
+    } catch (vk::OutOfPoolMemoryError &) {
+    } catch (vk::FragmentedPoolError &) { }
+
+    if (fresh)
+      throw std::runtime_error("descriptor set too big for a fresh pool");
+
+    // this pool's full, so move on to the next
+    chain.current++;
+  }
+}
+
+DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout) {
+  std::lock_guard guard(lock);
+
+  DescriptorSet result;
+  auto &reusable = free_sets[layout];
+  if (!reusable.empty()) {
+    result.set = reusable.back();
+    reusable.pop_back();
+    stats_.free--;
+  } else result.set = take(chain, layout);
+
+  result.allocator = this;
+  result.layout = layout;
+  stats_.live++;
+  return result;
+}
+
+vk::DescriptorSet DescriptorAllocator::allocate_transient(
+  uint32_t frame_index, vk::DescriptorSetLayout layout) {
+  std::lock_guard guard(lock);
+  return take(transient[frame_index], layout);
+}
+
+void DescriptorAllocator::reset(uint32_t frame_index) {
+  std::lock_guard guard(lock);
+  auto &chain = transient[frame_index];
+  for (size_t i = 0; i < chain.pools.size() && i <= chain.current; i++)
+    chain.pools[i].reset();
+  chain.current = 0;
+}
+
+void DescriptorAllocator::give(DescriptorSet &set) {
+  std::lock_guard guard(lock);
+  free_sets[set.layout].push_back(set.set);
+  stats_.live--;
+  stats_.free++;
+}
+
+DescriptorStats DescriptorAllocator::stats() {
+  std::lock_guard guard(lock);
+  return stats_;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class DescriptorAllocator;
+
+// what the allocator is holding on to
+struct DescriptorStats {
+  size_t pools = 0;
+
+  // sets handed out and sets waiting in the free lists to be handed out again
+  size_t live = 0;
+  size_t free = 0;
+};
+
+// a descriptor set from a DescriptorAllocator, kept for reuse by sets of the
+// same layout when dropped rather than freed. anything the gpu might still be
+// reading it for has to be done first, which Renderer::retire sees to
+class DescriptorSet {
+public:
+  DescriptorSet() = default;
+  DescriptorSet(std::nullptr_t) { }
+  ~DescriptorSet() { release(); }
+
+  DescriptorSet(const DescriptorSet &that) = delete;
+  DescriptorSet &operator=(const DescriptorSet &that) = delete;
+
+  DescriptorSet(DescriptorSet &&that) noexcept { swap(that); }
+
+  DescriptorSet &operator=(DescriptorSet &&that) noexcept {
+    DescriptorSet temp(std::move(that));
+    swap(temp);
+    return *this;
+  }
+
+  vk::DescriptorSet operator*() const { return set; }
+  operator vk::DescriptorSet() const { return set; }
+
+private:
+  vx::DescriptorAllocator *allocator = nullptr;
+  vk::DescriptorSetLayout layout;
+  vk::DescriptorSet set;
+
+  void release();
+  void swap(DescriptorSet &that) noexcept;
+
+  friend class vx::DescriptorAllocator;
+};
+
+// hands out descriptor sets from a chain of pools, starting another pool
+// whenever the last one runs out rather than sizing one up front. dropped
+// sets go on a free list per layout for the next set of that layout, so pools
+// never fragment and long lived sets never need freeing. transient sets come
+// from separate pools per frame in flight, reset all at once when that frame
+// comes around again
+class DescriptorAllocator {
+public:
+  // sets a pool has room for, and descriptors of each type per set, which
+  // together size every pool
+  static const uint32_t SETS_PER_POOL = 256;
+
+  DescriptorAllocator(vk::raii::Device &device,
+    std::vector<vk::DescriptorPoolSize> per_set, uint32_t in_flight);
+
+  DescriptorAllocator(const DescriptorAllocator &that) = delete;
+  DescriptorAllocator &operator=(const DescriptorAllocator &that) = delete;
+
+  vx::DescriptorSet allocate(vk::DescriptorSetLayout layout);
+
+  // a set only good until frame_index is reset, with nothing to give back
+  vk::DescriptorSet allocate_transient(uint32_t frame_index,
+    vk::DescriptorSetLayout layout);
+
+  // once frame_index's last use of them is done on the gpu
+  void reset(uint32_t frame_index);
+
+  vx::DescriptorStats stats();
+
+private:
+  // pools in the order they were made. sets are only ever taken from the
+  // last one, as the others have already run out
+  struct Chain {
+    std::vector<vk::raii::DescriptorPool> pools;
+    size_t current = 0;
+  };
+
+  vk::raii::Device &device;
+  std::vector<vk::DescriptorPoolSize> pool_sizes;
+
+  std::mutex lock;
+  Chain chain;
+  std::vector<Chain> transient;
+  std::map<VkDescriptorSetLayout, std::vector<vk::DescriptorSet>> free_sets;
+  vx::DescriptorStats stats_;
+
+  vk::DescriptorSet take(Chain &chain, vk::DescriptorSetLayout layout);
+  void give(vx::DescriptorSet &set);
+
+  friend class vx::DescriptorSet;
+};
+
+}
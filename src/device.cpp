@@ -1,37 +1,30 @@
 #include "device.hpp"
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <vulkan/vulkan_raii.hpp>
 
 using namespace vx;
 
-std::vector<vk::raii::CommandBuffer> CommandPool::create_buffers(uint32_t count)
+std::vector<vk::raii::CommandBuffer> CommandPool::create_buffers(uint32_t count,
+  vk::CommandBufferLevel level)
 {
   vk::CommandBufferAllocateInfo alloc_info {
     .commandPool = pool_,
-    .level = vk::CommandBufferLevel::ePrimary,
+    .level = level,
     .commandBufferCount = count
   };
 
   return vk::raii::CommandBuffers(device_.device(), alloc_info);
 }
 
-vk::raii::CommandBuffer CommandPool::create_buffer() {
-  return std::move(create_buffers(1).front());
+vk::raii::CommandBuffer CommandPool::create_buffer(
+  vk::CommandBufferLevel level) {
+  return std::move(create_buffers(1, level).front());
 }
 
 [[nodiscard]] vx::SingleTimeCommands CommandPool::single_time_commands() {
-  vk::CommandBufferAllocateInfo info {
-    .commandPool = pool_,
-    .level = vk::CommandBufferLevel::ePrimary,
-    .commandBufferCount = 1,
-  };
-
-  auto buffer = std::move(vk::raii::CommandBuffers(
-    device_.device(), info).front());
-  buffer.begin(vk::CommandBufferBeginInfo {
-    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
-  });
   return SingleTimeCommands(device_.queue(), device_.device(), pool_);
 }
 
@@ -41,21 +34,35 @@ VKAPI_ATTR vk::Bool32 VKAPI_CALL debug_cb(
   const vk::DebugUtilsMessengerCallbackDataEXT *pCallbackData,
   void *pUserData
 ) {
-  // just print the validation layer's debug message
-  std::cerr << "validation layer: type " << to_string(type) << " msg: " <<
-    pCallbackData->pMessage << std::endl;
+  // just print the validation layer's debug message. make validate looks
+  // for the severity, so keep it first
+  std::cerr << "validation layer: " << to_string(severity) << " type "
+    << to_string(type) << " msg: " << pCallbackData->pMessage << std::endl;
   return vk::False;
 }
 
 Device::Device(Window &window) {
-  create_instance();
+  create_instance(true);
   setup_debug();
   create_surface(window);
   pick_physical();
   create_logical();
+  allocator_ = std::make_unique<Allocator>(physical_, device_);
 }
 
-void Device::create_instance() {
+Device::Device() {
+  std::erase_if(device_exts, [](const char *ext) {
+    return !strcmp(ext, vk::KHRSwapchainExtensionName);
+  });
+
+  create_instance(false);
+  setup_debug();
+  pick_physical();
+  create_logical();
+  allocator_ = std::make_unique<Allocator>(physical_, device_);
+}
+
+void Device::create_instance(bool windowed) {
   // get required layers
   std::vector<const char *> required_layers;
   if (enable_validation_layers)
@@ -71,10 +78,13 @@ void Device::create_instance() {
     throw std::runtime_error("some required layers are unsupported");
   }
 
-  // get required glfw extensions
-  uint32_t ext_count = 0;
-  auto glfw_exts = glfwGetRequiredInstanceExtensions(&ext_count);
-  std::vector required_exts(glfw_exts, glfw_exts + ext_count);
+  // get required glfw extensions, which there's no need for without a window
+  std::vector<const char *> required_exts;
+  if (windowed) {
+    uint32_t ext_count = 0;
+    auto glfw_exts = glfwGetRequiredInstanceExtensions(&ext_count);
+    required_exts.assign(glfw_exts, glfw_exts + ext_count);
+  }
   if (enable_validation_layers)
     required_exts.push_back(vk::EXTDebugUtilsExtensionName);
 
@@ -145,9 +155,16 @@ void Device::pick_physical() {
     throw std::runtime_error("no vulkan compatible devices found! :(");
   }
 
+  // VX_DEVICE picks a device by part of its name, so a machine with both a
+  // gpu and lavapipe can be told to use either
+  const char *wanted = std::getenv("VX_DEVICE");
   for (const auto &device : devices) {
+    if (wanted && !strstr(device.getProperties().deviceName, wanted))
+      continue;
     if (is_suitable(device)) {
       physical_ = device;
+      std::cout << "using " << physical_.getProperties().deviceName
+        << std::endl;
       return;
     }
   }
@@ -175,12 +192,24 @@ bool Device::is_suitable(vk::raii::PhysicalDevice device) {
 
   // check features
   auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2,
-    vk::PhysicalDeviceVulkan11Features, vk::PhysicalDeviceVulkan13Features,
+    vk::PhysicalDeviceVulkan11Features, vk::PhysicalDeviceVulkan12Features,
+    vk::PhysicalDeviceVulkan13Features,
     vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>();
-  if (!features.get<vk::PhysicalDeviceFeatures2>()
-        .features.samplerAnisotropy ||
+  auto &features12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+  auto &features10 = features.get<vk::PhysicalDeviceFeatures2>().features;
+  if (!features10.samplerAnisotropy ||
+      !features10.drawIndirectFirstInstance ||
       !features.get<vk::PhysicalDeviceVulkan11Features>()
         .shaderDrawParameters ||
+      !features12.drawIndirectCount ||
+      !features12.runtimeDescriptorArray ||
+      !features12.timelineSemaphore ||
+      !features12.descriptorBindingPartiallyBound ||
+      !features12.descriptorBindingUpdateUnusedWhilePending ||
+      !features12.descriptorBindingSampledImageUpdateAfterBind ||
+      !features12.descriptorBindingStorageBufferUpdateAfterBind ||
+      !features12.shaderSampledImageArrayNonUniformIndexing ||
+      !features12.shaderStorageBufferArrayNonUniformIndexing ||
       !features.get<vk::PhysicalDeviceVulkan13Features>()
         .dynamicRendering ||
       !features.get<vk::PhysicalDeviceVulkan13Features>()
@@ -194,10 +223,10 @@ bool Device::is_suitable(vk::raii::PhysicalDevice device) {
 std::optional<uint32_t>
 Device::find_queue_fams(vk::raii::PhysicalDevice device) {
   // we want a queue family that can support both graphics and presenting to
-  // a window surface
+  // a window surface, if there is one
   auto queue_fams = device.getQueueFamilyProperties();
   for (uint32_t i = 0; i < queue_fams.size(); i++) {
-    if (device.getSurfaceSupportKHR(i, surface_) &&
+    if ((headless() || device.getSurfaceSupportKHR(i, surface_)) &&
       (queue_fams[i].queueFlags & vk::QueueFlagBits::eGraphics))
       return i;
   }
@@ -205,25 +234,73 @@ Device::find_queue_fams(vk::raii::PhysicalDevice device) {
   return std::nullopt;
 }
 
+uint32_t Device::find_transfer_fam() {
+  // a family that only does transfers is usually backed by dma engines, which
+  // can copy while the graphics queue is busy drawing. failing that, anything
+  // other than the graphics family still runs alongside it
+  auto queue_fams = physical_.getQueueFamilyProperties();
+  std::optional<uint32_t> other;
+  for (uint32_t i = 0; i < queue_fams.size(); i++) {
+    auto flags = queue_fams[i].queueFlags;
+    if (i == qindex || !(flags & vk::QueueFlagBits::eTransfer))
+      continue;
+    if (!(flags & (vk::QueueFlagBits::eGraphics |
+        vk::QueueFlagBits::eCompute)))
+      return i;
+    if (!other)
+      other = i;
+  }
+
+  return other.value_or(qindex);
+}
+
 void Device::create_logical() {
   // set up queue
   auto qfp = physical_.getQueueFamilyProperties();
   qindex = find_queue_fams(physical_).value();
+  transfer_qindex = find_transfer_fam();
   float queuePriority = 1;
-  vk::DeviceQueueCreateInfo queueCreateInfo {
-    .queueFamilyIndex = qindex,
-    .queueCount = 1,
-    .pQueuePriorities = &queuePriority
+  std::vector<vk::DeviceQueueCreateInfo> queue_infos {
+    vk::DeviceQueueCreateInfo {
+      .queueFamilyIndex = qindex,
+      .queueCount = 1,
+      .pQueuePriorities = &queuePriority
+    }
   };
+  if (separate_transfer()) {
+    queue_infos.push_back({
+      .queueFamilyIndex = transfer_qindex,
+      .queueCount = 1,
+      .pQueuePriorities = &queuePriority
+    });
+  }
 
   // set up device features
   vk::StructureChain features {
-    vk::PhysicalDeviceFeatures2 { .features = { .samplerAnisotropy = true } },
+    vk::PhysicalDeviceFeatures2 {
+      .features = {
+        .drawIndirectFirstInstance = true,
+        .samplerAnisotropy = true
+      }
+    },
     vk::PhysicalDeviceVulkan13Features {
       .synchronization2 = true,
       .dynamicRendering = true
     },
     vk::PhysicalDeviceVulkan11Features { .shaderDrawParameters = true },
+    // descriptor indexing and indirect count, for the bindless renderer, and
+    // timeline semaphores to track uploads
+    vk::PhysicalDeviceVulkan12Features {
+      .drawIndirectCount = true,
+      .shaderSampledImageArrayNonUniformIndexing = true,
+      .shaderStorageBufferArrayNonUniformIndexing = true,
+      .descriptorBindingSampledImageUpdateAfterBind = true,
+      .descriptorBindingStorageBufferUpdateAfterBind = true,
+      .descriptorBindingUpdateUnusedWhilePending = true,
+      .descriptorBindingPartiallyBound = true,
+      .runtimeDescriptorArray = true,
+      .timelineSemaphore = true
+    },
     vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT {
       .extendedDynamicState = true
     }
@@ -232,19 +309,20 @@ void Device::create_logical() {
   // create device and queue
   vk::DeviceCreateInfo deviceCreateInfo {
     .pNext = features.get<vk::PhysicalDeviceFeatures2>(),
-    .queueCreateInfoCount = 1,
-    .pQueueCreateInfos = &queueCreateInfo,
+    .queueCreateInfoCount = static_cast<uint32_t>(queue_infos.size()),
+    .pQueueCreateInfos = queue_infos.data(),
     .enabledExtensionCount = static_cast<uint32_t>(device_exts.size()),
     .ppEnabledExtensionNames = device_exts.data()
   };
 
   device_ = vk::raii::Device(physical_, deviceCreateInfo);
   queue_ = vk::raii::Queue(device_, qindex, 0);
+  transfer_queue_ = vk::raii::Queue(device_, transfer_qindex, 0);
 }
 
 void Device::create_image(
   vk::raii::Image &image,
-  vk::raii::DeviceMemory &mem,
+  vx::Allocation &mem,
   uint32_t width,
   uint32_t height,
   uint32_t depth,
@@ -253,6 +331,10 @@ void Device::create_image(
   vk::ImageUsageFlags usage,
   vk::MemoryPropertyFlags props
 ) {
+  // uploads happen on the transfer queue, so it has to share resources with
+  // the graphics queue. concurrent sharing saves handing every resource back
+  // and forth with ownership barriers
+  uint32_t families[] = {qindex, transfer_qindex};
   vk::ImageCreateInfo imageInfo {
     .imageType = depth == 1 ? vk::ImageType::e2D : vk::ImageType::e3D,
     .format = format,
@@ -262,19 +344,17 @@ void Device::create_image(
     .samples = vk::SampleCountFlagBits::e1,
     .tiling = tiling,
     .usage = usage,
-    .sharingMode = vk::SharingMode::eExclusive
+    .sharingMode = separate_transfer()
+      ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+    .queueFamilyIndexCount = separate_transfer() ? 2u : 0u,
+    .pQueueFamilyIndices = families
   };
 
   image = vk::raii::Image(device_, imageInfo);
 
-  vk::MemoryRequirements reqs = image.getMemoryRequirements();
-  vk::MemoryAllocateInfo allocInfo {
-    .allocationSize = reqs.size,
-    .memoryTypeIndex = find_mem_type(reqs.memoryTypeBits, props)
-  };
-
-  mem = vk::raii::DeviceMemory(device_, allocInfo);
-  image.bindMemory(mem, 0);
+  mem = allocator_->allocate(image.getMemoryRequirements(), props,
+    tiling == vk::ImageTiling::eLinear);
+  image.bindMemory(mem.memory(), mem.offset());
 }
 
 vk::raii::ImageView Device::create_view(
@@ -299,21 +379,6 @@ vk::raii::ImageView Device::create_view(
   return vk::raii::ImageView(device_, imageViewInfo);
 }
 
-uint32_t Device::find_mem_type(
-  uint32_t typeFilter,
-  vk::MemoryPropertyFlags propFilter
-) {
-  auto props = physical_.getMemoryProperties();
-
-  for (uint32_t i = 0; i < props.memoryTypeCount; i++) {
-    if ((typeFilter & (1 << i)) &&
-      (props.memoryTypes[i].propertyFlags & propFilter) == propFilter)
-      return i;
-  }
-
-  throw std::runtime_error("could not find suitable device memory");
-}
-
 vk::Format Device::find_supported_image_format(
   const std::vector<vk::Format> &formats,
   vk::ImageTiling tiling,
@@ -341,164 +406,27 @@ CommandPool Device::create_command_pool() {
   return CommandPool(*this, poolInfo);
 }
 
-void CommandPool::copy_to_image_staged(
-  vk::raii::Image &image,
-  void *data,
-  uint32_t width,
-  uint32_t height,
-  uint32_t depth,
-  float elem_size
-) {
-  // create staging buffer
-  vk::DeviceSize size = width * height * depth * elem_size;
-  vk::raii::Buffer staging = nullptr;
-  vk::raii::DeviceMemory stagingMem = nullptr;
-  device_.create_buffer(staging, stagingMem, size,
-    vk::BufferUsageFlagBits::eTransferSrc,
-    vk::MemoryPropertyFlagBits::eHostVisible |
-    vk::MemoryPropertyFlagBits::eHostCoherent);
-
-  // transfer pixel data into staging buffer
-  void *ptr = stagingMem.mapMemory(0, size);
-  memcpy(ptr, data, size);
-  stagingMem.unmapMemory();
-
-  // transfer staging buffer to image
-  transition_image_layout(image, vk::ImageLayout::eUndefined,
-    vk::ImageLayout::eTransferDstOptimal);
-  copy_buffer_to_image(image, staging, width, height, depth);
-  transition_image_layout(image, vk::ImageLayout::eTransferDstOptimal,
-    vk::ImageLayout::eShaderReadOnlyOptimal);
-}
-
-void CommandPool::copy_to_buffer_staged(
-  vk::raii::Buffer &buffer,
-  vk::raii::DeviceMemory &mem,
-  vk::BufferUsageFlags usage,
-  const void *data,
-  vk::DeviceSize size
-) {
-  // create buffer
-  if (buffer == nullptr || mem == nullptr)
-    device_.create_buffer(buffer, mem, size,
-      usage | vk::BufferUsageFlagBits::eTransferDst,
-      vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-  // create staging buffer
-  vk::raii::Buffer staging = nullptr;
-  vk::raii::DeviceMemory staging_mem = nullptr;
-  device_.create_buffer(staging, staging_mem, size,
-    vk::BufferUsageFlagBits::eTransferSrc,
-    vk::MemoryPropertyFlagBits::eHostVisible |
-    vk::MemoryPropertyFlagBits::eHostCoherent);
-
-  // write our data to staging buffer
-  void *ptr = staging_mem.mapMemory(0, size);
-  memcpy(ptr, data, size);
-  staging_mem.unmapMemory();
-
-  // copy staging buffer to buffer
-  copy_buffer(buffer, staging, size);
-}
-
 void Device::create_buffer(
   vk::raii::Buffer &buffer,
-  vk::raii::DeviceMemory &mem,
+  vx::Allocation &mem,
   vk::DeviceSize size,
   vk::BufferUsageFlags usage,
   vk::MemoryPropertyFlags props
 ) {
-  // create buffer
+  // create buffer, shared with the transfer queue like images are
+  uint32_t families[] = {qindex, transfer_qindex};
   vk::BufferCreateInfo buffer_info {
     .size = size,
     .usage = usage,
-    .sharingMode = vk::SharingMode::eExclusive
+    .sharingMode = separate_transfer()
+      ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+    .queueFamilyIndexCount = separate_transfer() ? 2u : 0u,
+    .pQueueFamilyIndices = families
   };
 
   buffer = vk::raii::Buffer(device_, buffer_info);
 
-  // allocate buffer in memory
-  vk::MemoryRequirements reqs = buffer.getMemoryRequirements();
-  uint32_t memIndex = find_mem_type(reqs.memoryTypeBits, props);
-  vk::MemoryAllocateInfo allocInfo {
-    .allocationSize = reqs.size,
-    .memoryTypeIndex = memIndex
-  };
-
-  mem = vk::raii::DeviceMemory(device_, allocInfo);
-
-  // bind the memory we just allocated to the buffer
-  buffer.bindMemory(mem, 0);
-}
-
-void CommandPool::copy_buffer(
-  vk::raii::Buffer &dst,
-  vk::raii::Buffer &src,
-  vk::DeviceSize size
-) {
-  auto copy_buffer = single_time_commands();
-  copy_buffer->copyBuffer(src, dst, vk::BufferCopy(0, 0, size));
-}
-
-void CommandPool::copy_buffer_to_image(
-  const vk::raii::Image &image,
-  const vk::raii::Buffer &buffer,
-  uint32_t width,
-  uint32_t height,
-  uint32_t depth
-) {
-  auto copy = single_time_commands();
-  vk::BufferImageCopy region {
-    .bufferOffset = 0,
-    .bufferRowLength = 0,
-    .bufferImageHeight = 0,
-    .imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
-    .imageOffset = {0, 0, 0},
-    .imageExtent = {width, height, depth}
-  };
-
-  copy->copyBufferToImage(buffer, image,
-    vk::ImageLayout::eTransferDstOptimal, region);
-}
-
-void CommandPool::transition_image_layout(
-  const vk::raii::Image &image,
-  vk::ImageLayout oldLayout,
-  vk::ImageLayout newLayout
-) {
-  auto transition = single_time_commands();
-
-  // pipeline barriers sync access to resources so that writes finish before
-  // reads start, but also used to transition image layouts and transfer
-  // exclusive resources between queues
-  vk::ImageMemoryBarrier barrier {
-    .oldLayout = oldLayout,
-    .newLayout = newLayout,
-    .image = image,
-    .subresourceRange = {
-      .aspectMask = vk::ImageAspectFlagBits::eColor,
-      .baseMipLevel = 0,
-      .levelCount = 1,
-      .baseArrayLayer = 0,
-      .layerCount = 1
-    },
-  };
-
-  vk::PipelineStageFlags srcStage;
-  vk::PipelineStageFlags dstStage;
-  if (oldLayout == vk::ImageLayout::eUndefined &&
-      newLayout == vk::ImageLayout::eTransferDstOptimal) {
-    barrier.srcAccessMask = {};
-    barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-    srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-    dstStage = vk::PipelineStageFlagBits::eTransfer;
-  } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal &&
-      newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-    srcStage = vk::PipelineStageFlagBits::eTransfer;
-    dstStage = vk::PipelineStageFlagBits::eFragmentShader;
-  } else throw std::invalid_argument("unsupported layout transition");
-
-  transition->pipelineBarrier(srcStage, dstStage, {}, {}, nullptr, barrier);
+  // carve some memory out for it and bind it
+  mem = allocator_->allocate(buffer.getMemoryRequirements(), props, true);
+  buffer.bindMemory(mem.memory(), mem.offset());
 }
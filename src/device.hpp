@@ -2,13 +2,18 @@
 
 #include <vulkan/vulkan_raii.hpp>
 
+#include "allocator.hpp"
 #include "window.hpp"
 
+#include <memory>
+
 namespace vx {
 
 class CommandPool;
 
+// records commands, then submits them and waits for them when dropped
 class SingleTimeCommands {
+public:
   SingleTimeCommands(const SingleTimeCommands &c) = delete;
   SingleTimeCommands &operator=(const SingleTimeCommands &c) = delete;
   SingleTimeCommands(const SingleTimeCommands &&c) = delete;
@@ -52,6 +57,12 @@ class Device {
 public:
   Device(vx::Window &window);
 
+  // a device with no window or surface, for rendering offscreen. any device
+  // that can do graphics will do, including software ones like lavapipe
+  Device();
+
+  bool headless() { return !*surface_; }
+
   void wait() { device_.waitIdle(); }
   void qwait() { queue_.waitIdle(); }
 
@@ -67,7 +78,7 @@ public:
 
   void create_image(
     vk::raii::Image &image,
-    vk::raii::DeviceMemory &mem,
+    vx::Allocation &mem,
     uint32_t width,
     uint32_t height,
     uint32_t depth,
@@ -93,7 +104,7 @@ public:
 
   void create_buffer(
     vk::raii::Buffer &buffer,
-    vk::raii::DeviceMemory &mem,
+    vx::Allocation &mem,
     vk::DeviceSize size,
     vk::BufferUsageFlags usage,
     vk::MemoryPropertyFlags props
@@ -108,6 +119,13 @@ public:
   uint32_t *queue_indices() { return &qindex; }
   vk::raii::Queue &queue() { return queue_; }
 
+  // the queue uploads go through, which is the graphics queue if there's no
+  // other family that can do transfers
+  uint32_t transfer_index() { return transfer_qindex; }
+  vk::raii::Queue &transfer_queue() { return transfer_queue_; }
+  bool separate_transfer() { return transfer_qindex != qindex; }
+  vx::Allocator &allocator() { return *allocator_; }
+
 private:
   #ifdef NDEBUG
   static constexpr bool enable_validation_layers = false;
@@ -119,7 +137,8 @@ private:
   };
   #endif
 
-  const std::vector<const char *> device_exts = {
+  // the swapchain extension is dropped when headless
+  std::vector<const char *> device_exts = {
     vk::KHRSwapchainExtensionName,
     vk::KHRSpirv14ExtensionName,
     vk::KHRSynchronization2ExtensionName,
@@ -135,8 +154,13 @@ private:
 
   uint32_t qindex;
   vk::raii::Queue queue_ = nullptr;
+  uint32_t transfer_qindex;
+  vk::raii::Queue transfer_queue_ = nullptr;
+
+  // after device_, so it's gone before the device is
+  std::unique_ptr<vx::Allocator> allocator_;
 
-  void create_instance();
+  void create_instance(bool windowed);
   void setup_debug();
   void create_surface(vx::Window &window);
   void pick_physical();
@@ -144,52 +168,17 @@ private:
 
   bool is_suitable(vk::raii::PhysicalDevice device);
   std::optional<uint32_t> find_queue_fams(vk::raii::PhysicalDevice device);
-
-  uint32_t find_mem_type(uint32_t typeFilter,
-    vk::MemoryPropertyFlags propFilter);
+  uint32_t find_transfer_fam();
 };
 
 class CommandPool {
 public:
-  std::vector<vk::raii::CommandBuffer> create_buffers(uint32_t count);
-  vk::raii::CommandBuffer create_buffer();
+  std::vector<vk::raii::CommandBuffer> create_buffers(uint32_t count,
+    vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
+  vk::raii::CommandBuffer create_buffer(
+    vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
   [[nodiscard]] vx::SingleTimeCommands single_time_commands();
 
-  void copy_to_image_staged(
-    vk::raii::Image &image,
-    void *data,
-    uint32_t width,
-    uint32_t height,
-    uint32_t depth,
-    float elem_size
-  );
-
-  void copy_to_buffer_staged(
-    vk::raii::Buffer &buffer,
-    vk::raii::DeviceMemory &mem,
-    vk::BufferUsageFlags usage,
-    const void *data,
-    vk::DeviceSize size);
-
-  void copy_buffer(
-    vk::raii::Buffer &dst,
-    vk::raii::Buffer &src,
-    vk::DeviceSize size);
-
-  void copy_buffer_to_image(
-    const vk::raii::Image &image,
-    const vk::raii::Buffer &buffer,
-    uint32_t width,
-    uint32_t height,
-    uint32_t depth
-  );
-
-  void transition_image_layout(
-    const vk::raii::Image &image,
-    vk::ImageLayout oldLayout,
-    vk::ImageLayout newLayout
-  );
-
   vx::Device &device() { return device_; }
   vk::raii::CommandPool &pool() { return pool_; }
 private:
@@ -12,7 +12,7 @@ struct GameObj {
 
   vx::UniformData uniforms;
 
-  std::vector<vk::raii::DescriptorSet> descriptor_sets;
+  std::vector<vx::DescriptorSet> descriptor_sets;
 
   void render(vx::Renderer &render);
 };
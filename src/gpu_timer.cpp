@@ -0,0 +1,141 @@
+#include "gpu_timer.hpp"
+#include "device.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace vx;
+
+GpuTimer::GpuTimer(Device &device, uint32_t in_flight)
+  : frames (in_flight) {
+  auto families = device.physical().getQueueFamilyProperties();
+  uint32_t bits = families[device.queue_index()].timestampValidBits;
+  if (bits == 0)
+    return;
+
+  period = device.physical().getProperties().limits.timestampPeriod;
+  mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+  pool = vk::raii::QueryPool(device.device(), vk::QueryPoolCreateInfo {
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * MAX_SECTIONS * in_flight
+  });
+}
+
+void GpuTimer::begin_frame(vk::raii::CommandBuffer &commands,
+  uint32_t frame_index) {
+  frame_ms_.reset();
+  if (!supported())
+    return;
+
+  collect(frame_index);
+  this->commands = &commands;
+  current = frame_index;
+  depth = 0;
+  frames[frame_index].number = frame_count++;
+  commands.resetQueryPool(pool, 2 * MAX_SECTIONS * frame_index,
+    2 * MAX_SECTIONS);
+  begin("frame");
+}
+
+void GpuTimer::end_frame() {
+  if (supported())
+    end(0);
+  commands = nullptr;
+}
+
+uint32_t GpuTimer::begin(const char *name) {
+  if (!supported() || !commands)
+    return NONE;
+
+  auto &frame = frames[current];
+  if (frame.sections.size() == MAX_SECTIONS)
+    return NONE;
+
+  // waiting on everything before means a section only counts its own work,
+  // at the cost of a little overlap between sections
+  uint32_t section = frame.sections.size();
+  frame.sections.push_back({ name, depth++ });
+  commands->writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, pool,
+    2 * (MAX_SECTIONS * current + section));
+  return section;
+}
+
+void GpuTimer::end(uint32_t section) {
+  if (section == NONE || !commands)
+    return;
+
+  depth--;
+  commands->writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, pool,
+    2 * (MAX_SECTIONS * current + section) + 1);
+}
+
+void GpuTimer::collect(uint32_t frame_index) {
+  auto &frame = frames[frame_index];
+  if (frame.sections.empty())
+    return;
+
+  // each query comes back as its value then whether it's available, so a
+  // section that was never ended is skipped rather than waited on
+  uint32_t count = 2 * frame.sections.size();
+  auto [result, words] = pool.getResults<uint64_t>(
+    2 * MAX_SECTIONS * frame_index, count, count * 2 * sizeof(uint64_t),
+    2 * sizeof(uint64_t),
+    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+
+  for (size_t i = 0; i < frame.sections.size(); i++) {
+    auto &section = frame.sections[i];
+    uint64_t *start = &words[4 * i];
+    uint64_t *end = &words[4 * i + 2];
+    if (!start[1] || !end[1])
+      continue;
+
+    double ms = ((end[0] - start[0]) & mask) * period / 1e6;
+    if (i == 0)
+      frame_ms_ = ms;
+
+    auto &stats = stats_[section.name];
+    stats.min_ms = stats.count ? std::min(stats.min_ms, ms) : ms;
+    stats.max_ms = stats.count ? std::max(stats.max_ms, ms) : ms;
+    stats.count++;
+    stats.last_ms = ms;
+    stats.total_ms += ms;
+
+    if (capturing) {
+      if (!base)
+        base = start[0];
+      captured.push_back({
+        .frame = frame.number,
+        .name = section.name,
+        .depth = section.depth,
+        .start_ms = ((start[0] - *base) & mask) * period / 1e6,
+        .ms = ms
+      });
+    }
+  }
+
+  frame.sections.clear();
+}
+
+void GpuTimer::write_csv(std::ostream &out) const {
+  out << std::fixed << std::setprecision(4);
+  out << "frame,section,depth,start_ms,ms\n";
+  for (auto &sample : captured) {
+    out << sample.frame << "," << sample.name << "," << sample.depth << "," <<
+      sample.start_ms << "," << sample.ms << "\n";
+  }
+}
+
+void GpuTimer::write_trace(std::ostream &out) const {
+  // complete events in microseconds, all on one track as they nest
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+    "\"args\": {\"name\": \"gpu\"}}";
+  for (auto &sample : captured) {
+    out << ",\n  {\"name\": \"" << sample.name << "\", \"ph\": \"X\", "
+      "\"pid\": 1, \"tid\": 0, \"ts\": " << sample.start_ms * 1000 <<
+      ", \"dur\": " << sample.ms * 1000 << ", \"args\": {\"frame\": " <<
+      sample.frame << "}}";
+  }
+  out << "\n]}\n";
+}
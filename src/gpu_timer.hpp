@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class Device;
+
+struct GpuSectionStats {
+  uint64_t count = 0;
+  double last_ms = 0;
+  double total_ms = 0;
+  double min_ms = 0;
+  double max_ms = 0;
+
+  double avg_ms() const { return count ? total_ms / count : 0; }
+};
+
+// times sections of each frame's commands on the gpu with timestamp queries.
+// every frame in flight gets its own queries, which are read back when the
+// frame comes around again and its fence has already said it's done, so
+// results are a couple of frames late but never stall. the whole frame is
+// always timed as "frame", with anything else nested inside it
+class GpuTimer {
+public:
+  // most sections a frame can have, past which begin does nothing
+  static const uint32_t MAX_SECTIONS = 32;
+  static const uint32_t NONE = UINT32_MAX;
+
+  GpuTimer(vx::Device &device, uint32_t in_flight);
+
+  GpuTimer(const GpuTimer &that) = delete;
+  GpuTimer &operator=(const GpuTimer &that) = delete;
+
+  // false if the graphics queue can't write timestamps, in which case
+  // everything else does nothing
+  bool supported() { return static_cast<bool>(*pool); }
+
+  // collects what frame_index recorded last time, then starts timing it
+  // again into commands
+  void begin_frame(vk::raii::CommandBuffer &commands, uint32_t frame_index);
+  void end_frame();
+
+  // name has to outlive the timer, which string literals do
+  uint32_t begin(const char *name);
+  void end(uint32_t section);
+
+  // the "frame" section of the last frame collected
+  std::optional<double> frame_ms() { return frame_ms_; }
+
+  // every section by name, over every frame collected so far
+  const std::map<std::string, GpuSectionStats> &stats() const {
+    return stats_;
+  }
+
+  // keeps every section collected from now on for the dumps below
+  void capture(bool capture) { capturing = capture; }
+  void write_csv(std::ostream &out) const;
+
+  // chrome's trace event format, which perfetto and about:tracing open
+  void write_trace(std::ostream &out) const;
+
+private:
+  struct Section {
+    const char *name;
+    uint32_t depth;
+  };
+
+  struct Frame {
+    uint64_t number = 0;
+    std::vector<Section> sections;
+  };
+
+  struct Sample {
+    uint64_t frame;
+    const char *name;
+    uint32_t depth;
+    double start_ms;
+    double ms;
+  };
+
+  vk::raii::QueryPool pool = nullptr;
+  double period = 0;
+  uint64_t mask = 0;
+
+  std::vector<Frame> frames;
+  vk::raii::CommandBuffer *commands = nullptr;
+  uint32_t current = 0;
+  uint32_t depth = 0;
+  uint64_t frame_count = 0;
+
+  std::optional<double> frame_ms_;
+  std::map<std::string, GpuSectionStats> stats_;
+
+  // captured samples start from the first timestamp ever read back
+  bool capturing = false;
+  std::optional<uint64_t> base;
+  std::vector<Sample> captured;
+
+  void collect(uint32_t frame_index);
+};
+
+// times the commands recorded while it's alive
+class GpuZone {
+public:
+  GpuZone(vx::GpuTimer &timer, const char *name)
+    : timer (timer)
+    , section (timer.begin(name)) { }
+  ~GpuZone() { timer.end(section); }
+
+  GpuZone(const GpuZone &that) = delete;
+  GpuZone &operator=(const GpuZone &that) = delete;
+
+private:
+  vx::GpuTimer &timer;
+  uint32_t section;
+};
+
+}
@@ -0,0 +1,169 @@
+#include "jobs.hpp"
+#include "profiler.hpp"
+
+#include <string>
+
+using namespace vx;
+
+// which queue belongs to the current thread. threads the job system doesn't
+// own, like the main thread, share the last queue
+static thread_local int queue_index = -1;
+
+JobSystem::JobSystem(unsigned threads) {
+  for (unsigned i = 0; i <= threads; i++)
+    queues.push_back(std::make_unique<Queue>());
+
+  for (unsigned i = 0; i < threads; i++)
+    this->threads.emplace_back([this, i] { work(i); });
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard lock(sleep_mutex);
+    stopping = true;
+  }
+  sleep.notify_all();
+
+  for (auto &thread : threads)
+    thread.join();
+}
+
+Job JobSystem::spawn(std::function<void()> fn, const std::vector<Job> &deps) {
+  auto job = std::make_shared<detail::JobState>();
+  job->fn = std::move(fn);
+  job->waiting = 1;
+
+  for (auto &dep : deps) {
+    if (!dep.state)
+      continue;
+    std::lock_guard lock(dep.state->mutex);
+    if (!dep.state->finished) {
+      job->waiting++;
+      dep.state->dependents.push_back(job);
+    }
+  }
+
+  // drop the spawning guard; if every dependency already finished then it's
+  // on us to schedule the job
+  if (--job->waiting == 0)
+    push(job);
+  return Job(job);
+}
+
+void JobSystem::on_main(std::function<void()> fn) {
+  std::lock_guard lock(main_mutex);
+  main_queue.push_back(std::move(fn));
+}
+
+size_t JobSystem::run_main(std::chrono::microseconds budget) {
+  auto start = std::chrono::steady_clock::now();
+  size_t count = 0;
+  while (std::chrono::steady_clock::now() - start < budget) {
+    std::function<void()> fn;
+    {
+      std::lock_guard lock(main_mutex);
+      if (main_queue.empty())
+        break;
+      fn = std::move(main_queue.front());
+      main_queue.pop_front();
+    }
+
+    fn();
+    count++;
+  }
+
+  return count;
+}
+
+void JobSystem::wait(const Job &job) {
+  unsigned index = queue_index < 0 ? threads.size() : queue_index;
+  while (!job.done()) {
+    if (auto next = take(index))
+      run(std::move(next));
+    else std::this_thread::yield();
+  }
+
+  if (job.state && job.state->error)
+    std::rethrow_exception(job.state->error);
+}
+
+void JobSystem::work(unsigned index) {
+  queue_index = index;
+  Profiler::name_thread("worker " + std::to_string(index));
+  while (true) {
+    if (auto job = take(index)) {
+      run(std::move(job));
+      continue;
+    }
+
+    std::unique_lock lock(sleep_mutex);
+    sleep.wait(lock, [&] { return stopping || queued > 0; });
+    if (stopping)
+      return;
+  }
+}
+
+void JobSystem::push(std::shared_ptr<detail::JobState> job) {
+  auto &queue = *queues[queue_index < 0 ? threads.size() : queue_index];
+  {
+    std::lock_guard lock(queue.mutex);
+    queue.jobs.push_back(std::move(job));
+  }
+
+  // taking the lock means a worker can't be between checking queued and
+  // going to sleep, so the notify can't get lost
+  queued++;
+  { std::lock_guard lock(sleep_mutex); }
+  sleep.notify_one();
+}
+
+std::shared_ptr<detail::JobState> JobSystem::take(unsigned index) {
+  // newest job from our own queue first, it's the most likely to be cache hot
+  {
+    auto &queue = *queues[index];
+    std::lock_guard lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      auto job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+      queued--;
+      return job;
+    }
+  }
+
+  // otherwise steal the oldest job from someone else
+  for (size_t i = 1; i < queues.size(); i++) {
+    auto &queue = *queues[(index + i) % queues.size()];
+    std::lock_guard lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      auto job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+      queued--;
+      stolen++;
+      return job;
+    }
+  }
+
+  return nullptr;
+}
+
+void JobSystem::run(std::shared_ptr<detail::JobState> job) {
+  try {
+    job->fn();
+  } catch (...) {
+    job->error = std::current_exception();
+  }
+  job->fn = nullptr;
+  executed++;
+
+  std::vector<std::shared_ptr<detail::JobState>> dependents;
+  {
+    std::lock_guard lock(job->mutex);
+    job->finished = true;
+    std::swap(dependents, job->dependents);
+  }
+
+  for (auto &dependent : dependents) {
+    if (--dependent->waiting == 0)
+      push(std::move(dependent));
+  }
+}
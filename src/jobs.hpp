@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vx {
+
+class JobSystem;
+
+namespace detail {
+
+struct JobState {
+  std::function<void()> fn;
+
+  // dependencies that haven't finished yet, plus one while the job is being
+  // spawned so it can't start before all of them are registered
+  std::atomic<int> waiting;
+
+  std::mutex mutex;
+  bool finished = false;
+  std::exception_ptr error;
+  std::vector<std::shared_ptr<JobState>> dependents;
+};
+
+}
+
+// handle to a spawned job, for waiting on it or making other jobs depend on it
+class Job {
+public:
+  Job() = default;
+
+  bool done() const {
+    if (!state)
+      return true;
+    std::lock_guard lock(state->mutex);
+    return state->finished;
+  }
+
+private:
+  Job(std::shared_ptr<detail::JobState> state) : state (std::move(state)) { }
+
+  std::shared_ptr<detail::JobState> state;
+
+  friend class vx::JobSystem;
+};
+
+struct JobStats {
+  uint64_t executed;
+  uint64_t stolen;
+};
+
+// work stealing scheduler. every worker, and the main thread, has its own
+// deque: owners push and pop at the back, idle workers steal from the front
+// of someone else's. jobs spawned from a job go on the spawning worker's deque
+// so related work tends to stay on one core
+class JobSystem {
+public:
+  // defaults to one worker per core, minus one for the main thread
+  JobSystem(unsigned threads =
+    std::max(2u, std::thread::hardware_concurrency()) - 1);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &jobs) = delete;
+  JobSystem &operator=(const JobSystem &jobs) = delete;
+
+  // runs fn on some worker once every job in deps has finished
+  Job spawn(std::function<void()> fn, const std::vector<Job> &deps = {});
+
+  // queues fn to run on the main thread the next time it calls run_main, for
+  // finishing off work that needs the gpu
+  void on_main(std::function<void()> fn);
+
+  // runs queued main thread callbacks until there are none left or the
+  // budget is spent, returning how many ran
+  size_t run_main(std::chrono::microseconds budget =
+    std::chrono::microseconds::max());
+
+  // helps run jobs until job has finished, then rethrows anything it threw
+  void wait(const Job &job);
+
+  unsigned thread_count() { return threads.size(); }
+  JobStats stats() { return { executed.load(), stolen.load() }; }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<detail::JobState>> jobs;
+  };
+
+  // one queue per worker, and the last one belongs to the main thread
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+
+  // how many jobs are sitting in queues, so idle workers know when to sleep
+  std::atomic<size_t> queued = 0;
+  std::mutex sleep_mutex;
+  std::condition_variable sleep;
+  bool stopping = false;
+
+  std::mutex main_mutex;
+  std::deque<std::function<void()>> main_queue;
+
+  std::atomic<uint64_t> executed = 0;
+  std::atomic<uint64_t> stolen = 0;
+
+  void work(unsigned index);
+  void push(std::shared_ptr<detail::JobState> job);
+  std::shared_ptr<detail::JobState> take(unsigned index);
+  void run(std::shared_ptr<detail::JobState> job);
+};
+
+}
@@ -1,14 +1,35 @@
 #include "camera.hpp"
+#include "camera_path.hpp"
 #include "chunk.hpp"
 #include "device.hpp"
+#include "jobs.hpp"
+#include "profiler.hpp"
 #include "renderer.hpp"
+#include "replay.hpp"
+#include "terrain.hpp"
 #include "texture.hpp"
 #include "window.hpp"
+#include "world.hpp"
 #include <vulkan/vulkan_raii.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
 using namespace std;
 
 vx::CameraAction cam_action = vx::CameraAction::None;
+bool switch_traversal = false;
+bool switch_path = false;
+bool dig = false;
+bool build = false;
 
 void key_callback(
   GLFWwindow *window,
@@ -45,6 +66,18 @@ void key_callback(
       case GLFW_KEY_LEFT_SHIFT:
         cam_action |= vx::CameraAction::MoveDown;
         break;
+      case GLFW_KEY_T:
+        switch_traversal = true;
+        break;
+      case GLFW_KEY_B:
+        switch_path = true;
+        break;
+      case GLFW_KEY_F:
+        dig = true;
+        break;
+      case GLFW_KEY_G:
+        build = true;
+        break;
     }
   } else if (action == GLFW_RELEASE) {
     switch (key) {
@@ -70,16 +103,160 @@ void key_callback(
   }
 }
 
-// TODO:
-// - sparse voxel octrees
-int main(void) {
-  vx::Window window(800, 600, "voxels");
-  window.set_key_callback(key_callback);
-  vx::Device device(window);
-  vx::Renderer render(window, device, 3);
-  vx::Chunk chunk(render, 0, 0, -2);
-  vx::Chunk chunk2(render, 0, 0, 0);
-  vx::Camera camera;
+struct Options {
+  bool headless = false;
+  int frames = 100;
+  const char *screenshot = nullptr;
+
+  // a camera path file, or "orbit" for one flown around the origin
+  const char *replay = nullptr;
+  const char *json = nullptr;
+  const char *record = nullptr;
+  uint32_t seed = 0;
+
+  // how far chunks load around the camera. 14 is over 10k of them
+  int radius = 3;
+
+  // how chunks are drawn, and whether per chunk draws are recorded on one
+  // thread rather than across the job system
+  vx::DrawPath path = vx::DrawPath::Bindless;
+  bool serial = false;
+
+  // dumps of every gpu section timed, see GpuTimer
+  const char *gpu_csv = nullptr;
+  const char *gpu_trace = nullptr;
+
+  // every thread's timeline, see Profiler
+  const char *cpu_trace = nullptr;
+
+  // how long pipelines take to build without and with a cache, see
+  // Renderer::time_pipelines
+  bool pipeline_times = false;
+};
+
+static Options parse_options(int argc, char **argv) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    auto value = [&] {
+      if (i + 1 >= argc)
+        throw runtime_error(string(argv[i]) + " needs a value");
+      return argv[++i];
+    };
+
+    if (!strcmp(argv[i], "--headless"))
+      opts.headless = true;
+    else if (!strcmp(argv[i], "--frames"))
+      opts.frames = max(atoi(value()), 1);
+    else if (!strcmp(argv[i], "--screenshot"))
+      opts.screenshot = value();
+    else if (!strcmp(argv[i], "--replay"))
+      opts.replay = value();
+    else if (!strcmp(argv[i], "--json"))
+      opts.json = value();
+    else if (!strcmp(argv[i], "--record"))
+      opts.record = value();
+    else if (!strcmp(argv[i], "--seed"))
+      opts.seed = strtoul(value(), nullptr, 0);
+    else if (!strcmp(argv[i], "--radius"))
+      opts.radius = max(atoi(value()), 0);
+    else if (!strcmp(argv[i], "--per-chunk"))
+      opts.path = vx::DrawPath::PerChunk;
+    else if (!strcmp(argv[i], "--grid"))
+      opts.path = vx::DrawPath::Grid;
+    else if (!strcmp(argv[i], "--compute"))
+      opts.path = vx::DrawPath::Compute;
+    else if (!strcmp(argv[i], "--clipmap"))
+      opts.path = vx::DrawPath::Clipmap;
+    else if (!strcmp(argv[i], "--serial"))
+      opts.serial = true;
+    else if (!strcmp(argv[i], "--gpu-csv"))
+      opts.gpu_csv = value();
+    else if (!strcmp(argv[i], "--gpu-trace"))
+      opts.gpu_trace = value();
+    else if (!strcmp(argv[i], "--cpu-trace"))
+      opts.cpu_trace = value();
+    else if (!strcmp(argv[i], "--pipeline-times"))
+      opts.pipeline_times = true;
+    else throw runtime_error(string("unknown option ") + argv[i] +
+      "\nusage: voxels [--headless] [--frames n] [--screenshot out.ppm]"
+      " [--replay path|orbit] [--json out.json] [--record out.path]"
+      " [--seed n] [--radius n] [--per-chunk|--grid|--compute|--clipmap]"
+      " [--serial]"
+      " [--gpu-csv out.csv] [--gpu-trace out.json] [--cpu-trace out.json]"
+      " [--pipeline-times]");
+  }
+  return opts;
+}
+
+static void write_file(const char *path,
+  const function<void(ostream &)> &write) {
+  ofstream file(path);
+  write(file);
+  if (!file.flush())
+    throw runtime_error(string("could not write ") + path);
+}
+
+static void write_screenshot(vx::Renderer &render, const char *out) {
+  auto pixels = render.read_frame();
+  auto extent = render.swapchain().extent();
+  ofstream file(out, ios::binary);
+  file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+  for (size_t i = 0; i < pixels.size(); i += 4)
+    file.write(reinterpret_cast<const char *>(&pixels[i]), 3);
+  if (!file.flush())
+    throw runtime_error(string("could not write ") + out);
+}
+
+// renders frames with the camera sat still and prints how long they took
+static void run_headless(vx::Renderer &render, vx::World &world,
+  vx::Camera &camera, int frames) {
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < frames; i++) {
+    world.update(render, camera);
+    if (!render.begin_frame(camera))
+      continue;
+    world.render(render);
+    render.end_frame();
+  }
+  render.device().wait();
+  double ms = chrono::duration<double, milli>(
+    chrono::steady_clock::now() - start).count();
+  cout << frames << " frames in " << ms << "ms (" << ms / frames
+    << "ms/frame)" << endl;
+}
+
+static void run_replay(vx::Renderer &render, vx::World &world,
+  vx::Camera &camera, vx::Window *window, const Options &opts) {
+  auto path = !strcmp(opts.replay, "orbit")
+    ? vx::CameraPath::orbit(4, 1, 20) : vx::CameraPath::load(opts.replay);
+
+  auto result = vx::replay(render, world, camera, path, 1.f / 60, [&] {
+    if (!window)
+      return true;
+    window->poll_events();
+    return !window->should_close();
+  });
+  render.device().wait();
+
+  vector<pair<const char *, double>> info {
+    {"seed", opts.seed},
+    {"chunk_count", static_cast<double>(vx::Chunk::COUNT)},
+    {"bindless", world.path() == vx::DrawPath::Bindless},
+    {"grid", world.path() == vx::DrawPath::Grid},
+    {"compute", world.path() == vx::DrawPath::Compute},
+    {"clipmap", world.path() == vx::DrawPath::Clipmap},
+    {"radius", world.radius()},
+    {"parallel", world.parallel()}
+  };
+  if (opts.json)
+    write_file(opts.json, [&](ostream &out) { result.write_json(out, info); });
+  else result.write_json(cout, info);
+}
+
+static void run_interactive(vx::Renderer &render, vx::World &world,
+  vx::Camera &camera, vx::Window &window, const char *record) {
+  vx::CameraPath recording;
+  float time = 0;
 
   while (!window.should_close()) {
     float dt = window.delta_time();
@@ -93,16 +270,101 @@ int main(void) {
       camera.update(dt);
     }
 
+    if (record) {
+      time += dt;
+      recording.add({time, camera.position(), camera.yaw_angle(),
+        camera.pitch_angle()});
+    }
+
+    if (switch_traversal) {
+      camera.toggle_traversal();
+      switch_traversal = false;
+    }
+
+    if (switch_path) {
+      auto next = (static_cast<int>(world.path()) + 1) % vx::DRAW_PATHS;
+      world.set_path(static_cast<vx::DrawPath>(next));
+      cout << "drawing " << vx::to_string(world.path()) << endl;
+      switch_path = false;
+    }
+
+    // edit a ball of voxels a little in front of the camera
+    if (dig || build) {
+      glm::vec3 target = (camera.position() + camera.forward() * 1.5f) *
+        static_cast<float>(vx::Chunk::COUNT / vx::Chunk::SIZE);
+      world.fill_sphere(target, 3,
+        dig ? vx::VoxelType::Empty : vx::VoxelType::Light);
+      dig = build = false;
+    }
+
+    world.update(render, camera);
+
     // render
     if (!render.begin_frame(camera))
       continue;
-    chunk.render(render);
-    chunk2.render(render);
+    world.render(render);
     render.end_frame();
     window.poll_events();
   }
 
-  device.wait();
+  if (record)
+    recording.save(record);
+}
+
+int main(int argc, char **argv) {
+  Options opts = parse_options(argc, argv);
+  vx::Profiler::name_thread("main");
+  vx::Profiler::enable(opts.cpu_trace);
+
+  // the window, device and renderer are only optional so headless runs can
+  // build them differently
+  const int radius = opts.radius;
+  optional<vx::Window> window;
+  optional<vx::Device> device;
+  optional<vx::Renderer> render;
+  if (opts.headless) {
+    device.emplace();
+    render.emplace(*device, vk::Extent2D {800, 600},
+      vx::World::capacity(radius));
+  } else {
+    window.emplace(800, 600, "voxels");
+    window->set_key_callback(key_callback);
+    device.emplace(*window);
+    render.emplace(*window, *device, vx::World::capacity(radius));
+  }
+
+  render->gpu_timer().capture(opts.gpu_csv || opts.gpu_trace);
+  if (opts.pipeline_times)
+    render->time_pipelines();
+
+  // declared in the order they're needed in, so the world goes first and
+  // waits for its jobs while the terrain they generate from is still there
+  vx::NoiseGenerator terrain({ .seed = opts.seed });
+  vx::JobSystem jobs;
+  vx::World world(jobs, terrain, radius);
+  world.set_path(opts.path);
+  world.set_parallel(!opts.serial);
+  vx::Camera camera;
+
+  if (opts.replay)
+    run_replay(*render, world, camera, window ? &*window : nullptr, opts);
+  else if (opts.headless)
+    run_headless(*render, world, camera, opts.frames);
+  else run_interactive(*render, world, camera, *window, opts.record);
+
+  device->wait();
+  if (opts.screenshot)
+    write_screenshot(*render, opts.screenshot);
+  if (opts.gpu_csv)
+    write_file(opts.gpu_csv, [&](ostream &out) {
+      render->gpu_timer().write_csv(out);
+    });
+  if (opts.gpu_trace)
+    write_file(opts.gpu_trace, [&](ostream &out) {
+      render->gpu_timer().write_trace(out);
+    });
+  if (opts.cpu_trace)
+    write_file(opts.cpu_trace, vx::Profiler::write_trace);
 
   return 0;
 }
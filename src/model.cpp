@@ -40,14 +40,35 @@ void Model::load_model(const char *path) {
   }
 }
 
-void Model::create_vertex_buffer(vx::CommandPool &pool) {
+void Model::create_vertex_buffer(vx::Renderer &render) {
   vk::DeviceSize size = sizeof(vertices_[0]) * vertices_.size();
-  pool.copy_to_buffer_staged(vbuffer, vmem,
-    vk::BufferUsageFlagBits::eVertexBuffer, vertices_.data(), size);
+  render.device().create_buffer(vbuffer, vmem, size,
+    vk::BufferUsageFlagBits::eVertexBuffer |
+    vk::BufferUsageFlagBits::eTransferDst,
+    vk::MemoryPropertyFlagBits::eDeviceLocal);
+  render.uploader().buffer(vbuffer, 0, vertices_.data(), size);
 }
 
-void Model::create_index_buffer(vx::CommandPool &pool) {
+void Model::create_index_buffer(vx::Renderer &render) {
   vk::DeviceSize size = sizeof(indices_[0]) * indices_.size();
-  pool.copy_to_buffer_staged(ibuffer, imem,
-    vk::BufferUsageFlagBits::eIndexBuffer, indices_.data(), size);
+  render.device().create_buffer(ibuffer, imem, size,
+    vk::BufferUsageFlagBits::eIndexBuffer |
+    vk::BufferUsageFlagBits::eTransferDst,
+    vk::MemoryPropertyFlagBits::eDeviceLocal);
+  render.uploader().buffer(ibuffer, 0, indices_.data(), size);
+}
+
+Job Model::load_async(JobSystem &jobs, Renderer &render, std::string path,
+  std::function<void(std::shared_ptr<Model>)> done) {
+  return jobs.spawn([&jobs, &render, path, done] {
+    auto model = std::shared_ptr<Model>(new Model());
+    model->load_model(path.c_str());
+
+    // the uploader is only used from the main thread
+    jobs.on_main([&render, model, done] {
+      model->create_vertex_buffer(render);
+      model->create_index_buffer(render);
+      done(model);
+    });
+  });
 }
@@ -9,6 +9,11 @@
 #include <glm/gtx/hash.hpp>
 
 #include "device.hpp"
+#include "jobs.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
 
 namespace vx {
 
@@ -58,29 +63,36 @@ class Model {
 public:
   Model(vx::Renderer &render, const char *path) {
     load_model(path);
-    create_vertex_buffer(render.pool());
-    create_index_buffer(render.pool());
+    create_vertex_buffer(render);
+    create_index_buffer(render);
   }
 
+  // parses the obj on a worker and uploads it on the main thread, calling
+  // done from the main thread once it's ready
+  static vx::Job load_async(vx::JobSystem &jobs, vx::Renderer &render,
+    std::string path, std::function<void(std::shared_ptr<Model>)> done);
+
   std::vector<Vertex> &vertices() { return vertices_; }
   std::vector<uint32_t> &indices() { return indices_; }
   vk::raii::Buffer &vertex_buffer() { return vbuffer; }
-  vk::raii::DeviceMemory &vertex_mem() { return vmem; }
+  vx::Allocation &vertex_mem() { return vmem; }
   vk::raii::Buffer &index_buffer() { return ibuffer; }
-  vk::raii::DeviceMemory &index_mem() { return imem; }
+  vx::Allocation &index_mem() { return imem; }
 
 private:
   std::vector<Vertex> vertices_;
   std::vector<uint32_t> indices_;
 
+  vx::Allocation vmem = nullptr;
   vk::raii::Buffer vbuffer = nullptr;
-  vk::raii::DeviceMemory vmem = nullptr;
+  vx::Allocation imem = nullptr;
   vk::raii::Buffer ibuffer = nullptr;
-  vk::raii::DeviceMemory imem = nullptr;
+
+  Model() = default;
 
   void load_model(const char *path);
-  void create_vertex_buffer(vx::CommandPool &pool);
-  void create_index_buffer(vx::CommandPool &pool);
+  void create_vertex_buffer(vx::Renderer &render);
+  void create_index_buffer(vx::Renderer &render);
 };
 
 }
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vx {
+
+// morton (z-order) codes for grids up to 1024 voxels across. each triple of
+// bits holds one bit of x, then y, then z, the same order as the octree's
+// octants, so every octant of a power of two grid is one contiguous run of
+// codes and counting up through them walks the octree depth first. a voxel's
+// neighbours are mostly within a few cache lines rather than a whole row or
+// slice away
+
+// the bits of a code belonging to each axis
+constexpr uint32_t MORTON_X = 0x09249249;
+constexpr uint32_t MORTON_Y = MORTON_X << 1;
+constexpr uint32_t MORTON_Z = MORTON_X << 2;
+
+// spreads the low 10 bits of v out to every third bit
+constexpr uint32_t morton_spread(uint32_t v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// gathers every third bit of v back together
+constexpr uint32_t morton_compact(uint32_t v) {
+  v &= 0x09249249;
+  v = (v | (v >> 2)) & 0x030c30c3;
+  v = (v | (v >> 4)) & 0x0300f00f;
+  v = (v | (v >> 8)) & 0x030000ff;
+  v = (v | (v >> 16)) & 0x000003ff;
+  return v;
+}
+
+constexpr uint32_t morton_encode(uint32_t x, uint32_t y, uint32_t z) {
+  return morton_spread(x) | morton_spread(y) << 1 | morton_spread(z) << 2;
+}
+
+constexpr uint32_t morton_x(uint32_t code) { return morton_compact(code); }
+constexpr uint32_t morton_y(uint32_t code) { return morton_compact(code >> 1); }
+constexpr uint32_t morton_z(uint32_t code) { return morton_compact(code >> 2); }
+
+// steps a code one voxel up or down the axis given by its mask without
+// decoding it, by carrying through that axis' bits alone. stepping off the
+// edge of the 1024 grid wraps, so check bounds first
+constexpr uint32_t morton_inc(uint32_t code, uint32_t axis) {
+  return (((code | ~axis) + 1) & axis) | (code & ~axis);
+}
+
+constexpr uint32_t morton_dec(uint32_t code, uint32_t axis) {
+  return (((code & axis) - 1) & axis) | (code & ~axis);
+}
+
+// how a count^3 grid of voxels is laid out in memory: [z][y][x] rows, or by
+// morton code
+enum class VoxelLayout { Linear, Morton };
+
+// copies a count^3 grid indexed [z][y][x] into morton order, or back
+template <typename T>
+void to_morton(const T *linear, int count, T *morton) {
+  size_t i = 0;
+  for (int z = 0; z < count; z++) {
+    for (int y = 0; y < count; y++) {
+      uint32_t code = morton_encode(0, y, z);
+      for (int x = 0; x < count; x++, i++) {
+        morton[code] = linear[i];
+        code = morton_inc(code, MORTON_X);
+      }
+    }
+  }
+}
+
+template <typename T>
+void from_morton(const T *morton, int count, T *linear) {
+  size_t i = 0;
+  for (int z = 0; z < count; z++) {
+    for (int y = 0; y < count; y++) {
+      uint32_t code = morton_encode(0, y, z);
+      for (int x = 0; x < count; x++, i++) {
+        linear[i] = morton[code];
+        code = morton_inc(code, MORTON_X);
+      }
+    }
+  }
+}
+
+}
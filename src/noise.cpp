@@ -0,0 +1,128 @@
+#include "noise.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VX_NOISE_X86
+#endif
+
+namespace {
+
+// one lane wide versions of the vector types the kernels are written against
+struct Vm {
+  bool v;
+};
+
+struct Vf {
+  float v;
+  Vf(float v) : v (v) { }
+};
+
+struct Vi {
+  uint32_t v;
+  Vi(uint32_t v) : v (v) { }
+};
+
+inline Vf operator+(Vf a, Vf b) { return a.v + b.v; }
+inline Vf operator-(Vf a, Vf b) { return a.v - b.v; }
+inline Vf operator*(Vf a, Vf b) { return a.v * b.v; }
+inline Vi operator+(Vi a, Vi b) { return a.v + b.v; }
+inline Vi operator*(Vi a, Vi b) { return a.v * b.v; }
+inline Vi operator^(Vi a, Vi b) { return a.v ^ b.v; }
+inline Vi operator&(Vi a, Vi b) { return a.v & b.v; }
+inline Vm operator~(Vm a) { return {!a.v}; }
+inline Vm operator&(Vm a, Vm b) { return {a.v && b.v}; }
+inline Vm operator|(Vm a, Vm b) { return {a.v || b.v}; }
+
+inline Vf floor(Vf a) { return std::floor(a.v); }
+inline Vf max(Vf a, Vf b) { return a.v > b.v ? a.v : b.v; }
+inline Vi to_int(Vf a) {
+  return static_cast<uint32_t>(static_cast<int32_t>(a.v));
+}
+inline Vi srl(Vi a, int n) { return a.v >> n; }
+inline Vm less(Vi a, Vi b) {
+  return {static_cast<int32_t>(a.v) < static_cast<int32_t>(b.v)};
+}
+inline Vm eq(Vi a, Vi b) { return {a.v == b.v}; }
+inline Vm ge(Vf a, Vf b) { return {a.v >= b.v}; }
+inline Vf select(Vm m, Vf a, Vf b) { return m.v ? a : b; }
+inline Vi select(Vm m, Vi a, Vi b) { return m.v ? a : b; }
+
+}
+
+#include "noise_kernels.hpp"
+
+using namespace vx;
+
+static void perlin8_scalar(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out) {
+  for (int i = 0; i < 8; i++)
+    out[i] = kernels::perlin(Vf(x[i]), Vf(y[i]), Vf(z[i]), Vi(seed)).v;
+}
+
+static void simplex8_scalar(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out) {
+  for (int i = 0; i < 8; i++)
+    out[i] = kernels::simplex(Vf(x[i]), Vf(y[i]), Vf(z[i]), Vi(seed)).v;
+}
+
+bool vx::isa_supported(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar:
+      return true;
+#ifdef VX_NOISE_X86
+    case Isa::Sse41:
+      return __builtin_cpu_supports("sse4.1");
+    case Isa::Avx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+Isa vx::best_isa() {
+  static const Isa best = isa_supported(Isa::Avx2) ? Isa::Avx2
+    : isa_supported(Isa::Sse41) ? Isa::Sse41
+    : Isa::Scalar;
+  return best;
+}
+
+Noise8 vx::noise8(NoiseKernel kernel, Isa isa) {
+  if (!isa_supported(isa))
+    throw std::invalid_argument("instruction set unsupported by this cpu");
+
+  switch (isa) {
+#ifdef VX_NOISE_X86
+    case Isa::Avx2:
+      return kernel == NoiseKernel::Perlin ? perlin8_avx2 : simplex8_avx2;
+    case Isa::Sse41:
+      return kernel == NoiseKernel::Perlin ? perlin8_sse41 : simplex8_sse41;
+#endif
+    default:
+      return kernel == NoiseKernel::Perlin ? perlin8_scalar : simplex8_scalar;
+  }
+}
+
+const char *vx::to_string(NoiseKernel kernel) {
+  switch (kernel) {
+    case NoiseKernel::Perlin:
+      return "perlin";
+    case NoiseKernel::Simplex:
+      return "simplex";
+  }
+  return "unknown";
+}
+
+const char *vx::to_string(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar:
+      return "scalar";
+    case Isa::Sse41:
+      return "sse4.1";
+    case Isa::Avx2:
+      return "avx2";
+  }
+  return "unknown";
+}
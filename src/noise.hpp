@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vx {
+
+enum class NoiseKernel {
+  Perlin,
+  Simplex,
+};
+
+// instruction sets the noise kernels are built for. every one of them gives
+// bit-identical output, they only differ in speed
+enum class Isa {
+  Scalar,
+  Sse41,
+  Avx2,
+};
+
+// evaluates noise at 8 points at once
+using Noise8 = void (*)(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out);
+
+// the fastest instruction set this cpu supports
+Isa best_isa();
+bool isa_supported(Isa isa);
+
+Noise8 noise8(NoiseKernel kernel, Isa isa = best_isa());
+
+const char *to_string(NoiseKernel kernel);
+const char *to_string(Isa isa);
+
+// the simd builds, which live in src/simd so they can be compiled with their
+// own instruction set flags
+void perlin8_sse41(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out);
+void simplex8_sse41(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out);
+void perlin8_avx2(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out);
+void simplex8_avx2(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out);
+
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+// noise kernels written once against a small vector interface, so the scalar,
+// sse4.1 and avx2 builds share the exact same sequence of operations and so
+// produce bit-identical results for a given seed. each build defines
+//
+//   Vf  a vector of floats          Vi  a vector of 32 bit unsigned ints
+//   Vm  a lane mask from a comparison
+//
+// along with arithmetic on them and floor, to_int, srl (logical right
+// shift), less, eq, ge, select (mask ? a : b), max and ~ & | on masks, then
+// includes this header
+
+#include <cstdint>
+
+namespace vx::kernels {
+
+template <typename Vi>
+inline Vi hash(Vi x, Vi y, Vi z, Vi seed) {
+  // lowbias32 finaliser over a cheap combination of the coordinates
+  Vi h = seed ^ (x * Vi(0x8da6b343u)) ^ (y * Vi(0xd8163841u)) ^
+    (z * Vi(0xcb1ab31fu));
+  h = h ^ srl(h, 16);
+  h = h * Vi(0x7feb352du);
+  h = h ^ srl(h, 15);
+  h = h * Vi(0x846ca68bu);
+  h = h ^ srl(h, 16);
+  return h;
+}
+
+// perlin's improved noise gradients: the 12 cube edges, with 4 repeated to
+// make 16 so picking one is a mask rather than a modulo
+template <typename Vf, typename Vi>
+inline Vf grad(Vi hash, Vf x, Vf y, Vf z) {
+  Vi h = hash & Vi(15u);
+  Vf u = select(less(h, Vi(8u)), x, y);
+  Vf v = select(less(h, Vi(4u)), y,
+    select(eq(h, Vi(12u)) | eq(h, Vi(14u)), x, z));
+  Vf su = select(eq(h & Vi(1u), Vi(0u)), u, Vf(0.f) - u);
+  Vf sv = select(eq(h & Vi(2u), Vi(0u)), v, Vf(0.f) - v);
+  return su + sv;
+}
+
+template <typename Vf>
+inline Vf fade(Vf t) {
+  return t * t * t * (t * (t * Vf(6.f) - Vf(15.f)) + Vf(10.f));
+}
+
+template <typename Vf>
+inline Vf lerp(Vf t, Vf a, Vf b) {
+  return a + t * (b - a);
+}
+
+template <typename Vf, typename Vi>
+inline Vf perlin(Vf x, Vf y, Vf z, Vi seed) {
+  Vf fx = floor(x);
+  Vf fy = floor(y);
+  Vf fz = floor(z);
+  Vi ix = to_int(fx);
+  Vi iy = to_int(fy);
+  Vi iz = to_int(fz);
+  Vf tx = x - fx;
+  Vf ty = y - fy;
+  Vf tz = z - fz;
+  Vf u = fade(tx);
+  Vf v = fade(ty);
+  Vf w = fade(tz);
+
+  Vi one(1u);
+  Vf onef(1.f);
+  Vf n000 = grad(hash(ix, iy, iz, seed), tx, ty, tz);
+  Vf n100 = grad(hash(ix + one, iy, iz, seed), tx - onef, ty, tz);
+  Vf n010 = grad(hash(ix, iy + one, iz, seed), tx, ty - onef, tz);
+  Vf n110 = grad(hash(ix + one, iy + one, iz, seed), tx - onef, ty - onef,
+    tz);
+  Vf n001 = grad(hash(ix, iy, iz + one, seed), tx, ty, tz - onef);
+  Vf n101 = grad(hash(ix + one, iy, iz + one, seed), tx - onef, ty,
+    tz - onef);
+  Vf n011 = grad(hash(ix, iy + one, iz + one, seed), tx, ty - onef,
+    tz - onef);
+  Vf n111 = grad(hash(ix + one, iy + one, iz + one, seed), tx - onef,
+    ty - onef, tz - onef);
+
+  return lerp(w,
+    lerp(v, lerp(u, n000, n100), lerp(u, n010, n110)),
+    lerp(v, lerp(u, n001, n101), lerp(u, n011, n111)));
+}
+
+template <typename Vf, typename Vi>
+inline Vf simplex_corner(Vf x, Vf y, Vf z, Vi hash) {
+  Vf t = max(Vf(.6f) - x * x - y * y - z * z, Vf(0.f));
+  t = t * t;
+  return t * t * grad(hash, x, y, z);
+}
+
+// gustavson's 3d simplex noise, branch free
+template <typename Vf, typename Vi>
+inline Vf simplex(Vf x, Vf y, Vf z, Vi seed) {
+  const float F3 = 1.f / 3.f;
+  const float G3 = 1.f / 6.f;
+
+  // skew into simplex space to find which cell we're in
+  Vf s = (x + y + z) * Vf(F3);
+  Vf fi = floor(x + s);
+  Vf fj = floor(y + s);
+  Vf fk = floor(z + s);
+  Vf t = (fi + fj + fk) * Vf(G3);
+  Vf x0 = x - (fi - t);
+  Vf y0 = y - (fj - t);
+  Vf z0 = z - (fk - t);
+
+  // rank the offsets to find which of the six tetrahedra we're in
+  auto x_ge_y = ge(x0, y0);
+  auto y_ge_z = ge(y0, z0);
+  auto x_ge_z = ge(x0, z0);
+  auto i1 = x_ge_y & x_ge_z;
+  auto j1 = ~x_ge_y & y_ge_z;
+  auto k1 = ~x_ge_z & ~y_ge_z;
+  auto i2 = x_ge_y | x_ge_z;
+  auto j2 = ~x_ge_y | y_ge_z;
+  auto k2 = ~x_ge_z | ~y_ge_z;
+
+  Vf zero(0.f);
+  Vf onef(1.f);
+  Vf x1 = x0 - select(i1, onef, zero) + Vf(G3);
+  Vf y1 = y0 - select(j1, onef, zero) + Vf(G3);
+  Vf z1 = z0 - select(k1, onef, zero) + Vf(G3);
+  Vf x2 = x0 - select(i2, onef, zero) + Vf(2.f * G3);
+  Vf y2 = y0 - select(j2, onef, zero) + Vf(2.f * G3);
+  Vf z2 = z0 - select(k2, onef, zero) + Vf(2.f * G3);
+  Vf x3 = x0 - onef + Vf(3.f * G3);
+  Vf y3 = y0 - onef + Vf(3.f * G3);
+  Vf z3 = z0 - onef + Vf(3.f * G3);
+
+  Vi i = to_int(fi);
+  Vi j = to_int(fj);
+  Vi k = to_int(fk);
+  Vi one(1u);
+  Vi zeroi(0u);
+  Vf n = simplex_corner(x0, y0, z0, hash(i, j, k, seed));
+  n = n + simplex_corner(x1, y1, z1, hash(
+    i + select(i1, one, zeroi),
+    j + select(j1, one, zeroi),
+    k + select(k1, one, zeroi), seed));
+  n = n + simplex_corner(x2, y2, z2, hash(
+    i + select(i2, one, zeroi),
+    j + select(j2, one, zeroi),
+    k + select(k2, one, zeroi), seed));
+  n = n + simplex_corner(x3, y3, z3, hash(i + one, j + one, k + one, seed));
+
+  // scale to roughly [-1, 1]
+  return n * Vf(32.f);
+}
+
+}
@@ -0,0 +1,108 @@
+#include "occupancy.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace vx;
+
+// how far past a cell boundary we sample so we land in the next cell
+static const float NUDGE = 1e-4;
+
+Occupancy::Occupancy(const PalettedVoxels &voxels, int count)
+  : bricks_ ((count / BRICK) * (count / BRICK) * (count / BRICK))
+  , count_ (count / BRICK) {
+  if (count <= 0 || count % BRICK)
+    throw std::invalid_argument("chunk size must be a multiple of 4");
+
+  for (int z = 0; z < count; z++) {
+    for (int y = 0; y < count; y++) {
+      for (int x = 0; x < count; x++) {
+        if (!voxels.index((z * count + y) * count + x))
+          continue;
+        int bit = x % BRICK + y % BRICK * BRICK + z % BRICK * BRICK * BRICK;
+        bricks_[(z / BRICK * count_ + y / BRICK) * count_ + x / BRICK] |=
+          uint64_t(1) << bit;
+      }
+    }
+  }
+}
+
+Octree::Hit Occupancy::raycast(const PalettedVoxels &voxels,
+  const float pos[3], const float dir[3], int limit, float start,
+  float end) const {
+  Octree::Hit hit { .voxel = 0, .t = end, .normal = {0, 0, 0}, .steps = 0 };
+
+  // clip the ray to the unit cube
+  float inv[3];
+  float t_enter = -INFINITY;
+  float t_exit = INFINITY;
+  int axis = 0;
+  for (int i = 0; i < 3; i++) {
+    inv[i] = 1.f / dir[i];
+    float t0 = -pos[i] * inv[i];
+    float t1 = (1.f - pos[i]) * inv[i];
+    if (std::min(t0, t1) > t_enter) {
+      t_enter = std::min(t0, t1);
+      axis = i;
+    }
+    t_exit = std::min(t_exit, std::max(t0, t1));
+  }
+
+  if (t_enter > t_exit || t_exit < start)
+    return hit;
+
+  float t = std::max(start, t_enter);
+  t_exit = std::min(t_exit, end);
+  float normal[3] = {0, 0, 0};
+  normal[axis] = dir[axis] > 0 ? -1 : 1;
+
+  int n = count_ * BRICK;
+  float voxel_size = 1.f / n;
+  while (hit.steps < limit && t < t_exit) {
+    hit.steps++;
+
+    int coord[3];
+    for (int i = 0; i < 3; i++) {
+      float p = pos[i] + (t + NUDGE) * dir[i];
+      coord[i] = std::clamp(static_cast<int>(std::floor(p * n)), 0, n - 1);
+    }
+
+    // an empty brick is skipped whole, otherwise we step one voxel at a time
+    float lo[3];
+    float size;
+    if (!brick(coord[0] / BRICK, coord[1] / BRICK, coord[2] / BRICK)) {
+      for (int i = 0; i < 3; i++)
+        lo[i] = coord[i] / BRICK * BRICK * voxel_size;
+      size = BRICK * voxel_size;
+    } else if (solid(coord[0], coord[1], coord[2])) {
+      hit.voxel = voxels.get((coord[2] * n + coord[1]) * n + coord[0]);
+      hit.t = t;
+      std::copy(normal, normal + 3, hit.normal);
+      return hit;
+    } else {
+      for (int i = 0; i < 3; i++)
+        lo[i] = coord[i] * voxel_size;
+      size = voxel_size;
+    }
+
+    // jump to the far side of the empty cell
+    float t_far = INFINITY;
+    for (int i = 0; i < 3; i++) {
+      if (dir[i] == 0)
+        continue;
+      float plane = lo[i] + (dir[i] > 0 ? size : 0);
+      float t_plane = (plane - pos[i]) * inv[i];
+      if (t_plane < t_far) {
+        t_far = t_plane;
+        axis = i;
+      }
+    }
+
+    t = t_far;
+    std::fill(normal, normal + 3, 0);
+    normal[axis] = dir[axis] > 0 ? -1 : 1;
+  }
+
+  return hit;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "octree.hpp"
+#include "palette.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace vx {
+
+// a coarse level over a chunk's voxels: one 64 bit mask per 4x4x4 brick
+// saying which of its voxels are solid. the raymarcher crosses an empty
+// brick in one step and only reads the voxel image once the mask says it's
+// going to hit something
+//
+// bricks are indexed [z][y][x] like the voxels, and bit x + 4y + 16z of a
+// brick's mask is the voxel at that offset inside it. on the gpu each mask is
+// a uint2 of its low then high 32 bits
+class Occupancy {
+public:
+  static const int BRICK = 4;
+
+  Occupancy() = default;
+
+  // voxels is a count^3 grid indexed [z][y][x], count a multiple of BRICK
+  Occupancy(const PalettedVoxels &voxels, int count);
+
+  const std::vector<uint64_t> &bricks() const { return bricks_; }
+
+  // bricks along each axis
+  int count() const { return count_; }
+
+  uint64_t brick(int x, int y, int z) const {
+    return bricks_[(z * count_ + y) * count_ + x];
+  }
+
+  bool solid(int x, int y, int z) const {
+    uint64_t mask = brick(x / BRICK, y / BRICK, z / BRICK);
+    int bit = x % BRICK + y % BRICK * BRICK + z % BRICK * BRICK * BRICK;
+    return mask >> bit & 1;
+  }
+
+  void set(int x, int y, int z, bool solid) {
+    uint64_t &mask = bricks_[(z / BRICK * count_ + y / BRICK) * count_ +
+      x / BRICK];
+    int bit = x % BRICK + y % BRICK * BRICK + z % BRICK * BRICK * BRICK;
+    mask = (mask & ~(uint64_t(1) << bit)) | (uint64_t(solid) << bit);
+  }
+
+  // cpu mirror of raymarch in shader.slang, in chunk space like
+  // Octree::raycast
+  Octree::Hit raycast(const PalettedVoxels &voxels, const float pos[3],
+    const float dir[3], int limit, float start, float end) const;
+
+private:
+  std::vector<uint64_t> bricks_;
+  int count_ = 0;
+};
+
+}
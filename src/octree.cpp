@@ -0,0 +1,211 @@
+#include "octree.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+using namespace vx;
+
+// how far past a cell boundary we sample so we land in the next cell
+static const float NUDGE = 1e-4;
+
+Octree::Octree(const uint32_t *voxels, int count, VoxelLayout layout)
+  : count_ (count)
+  , layout (layout) {
+  if (count <= 0 || !std::has_single_bit(static_cast<unsigned>(count)))
+    throw std::invalid_argument("octree size must be a power of two");
+
+  // the root has to be node 0, so reserve it before building its children
+  nodes_.push_back(0);
+  nodes_[0] = build(voxels, 0, 0, 0, count);
+}
+
+uint32_t Octree::build(const uint32_t *voxels, int x, int y, int z,
+  int size) {
+  if (size == 1) {
+    // leaves are reached in morton order, so a morton grid is just read
+    // through from the start
+    uint32_t voxel = layout == VoxelLayout::Morton ? voxels[next_leaf++]
+      : voxels[(z * count_ + y) * count_ + x];
+    return voxel ? LEAF | voxel : 0;
+  }
+
+  int half = size / 2;
+  uint32_t children[8];
+  for (int i = 0; i < 8; i++) {
+    children[i] = build(voxels,
+      x + (i & 1 ? half : 0),
+      y + (i & 2 ? half : 0),
+      z + (i & 4 ? half : 0),
+      half);
+  }
+
+  // all empty or all the same leaf collapses into its parent
+  if (std::all_of(children + 1, children + 8,
+      [&](uint32_t c) { return c == children[0]; }) &&
+      (children[0] == 0 || children[0] & LEAF))
+    return children[0];
+
+  uint32_t mask = 0;
+  uint32_t first = nodes_.size();
+  for (int i = 0; i < 8; i++) {
+    if (children[i] == 0)
+      continue;
+    mask |= 1 << i;
+    nodes_.push_back(children[i]);
+  }
+
+  // any higher and the index would run into LEAF
+  if (first >= (1 << 23))
+    throw std::length_error("octree has too many nodes");
+  return (first << 8) | mask;
+}
+
+uint32_t Octree::at(int x, int y, int z) const {
+  return at(x, y, z, 1);
+}
+
+uint32_t Octree::at(int x, int y, int z, int size) const {
+  uint32_t node = nodes_[0];
+  int extent = count_;
+  while (node != 0 && !(node & LEAF) && extent > size) {
+    extent /= 2;
+    int octant = (x & extent ? 1 : 0) | (y & extent ? 2 : 0) |
+      (z & extent ? 4 : 0);
+    uint32_t mask = node & 0xff;
+    if (!(mask & (1 << octant)))
+      return 0;
+    node = nodes_[(node >> 8) + std::popcount(mask & ((1u << octant) - 1))];
+  }
+
+  // only non-empty children are stored, so the first child of a branch
+  // always leads down to a solid voxel
+  while (node != 0 && !(node & LEAF))
+    node = nodes_[node >> 8];
+
+  return node & ~LEAF;
+}
+
+Octree::Bounds Octree::bounds() const {
+  Bounds bounds {
+    .lo = {count_, count_, count_},
+    .hi = {0, 0, 0}
+  };
+  grow(bounds, nodes_[0], 0, 0, 0, count_);
+  if (bounds.lo[0] >= bounds.hi[0])
+    return { .lo = {0, 0, 0}, .hi = {0, 0, 0} };
+  return bounds;
+}
+
+void Octree::grow(Bounds &bounds, uint32_t node, int x, int y, int z,
+  int size) const {
+  if (node == 0)
+    return;
+
+  if (node & LEAF) {
+    int corner[3] = {x, y, z};
+    for (int i = 0; i < 3; i++) {
+      bounds.lo[i] = std::min(bounds.lo[i], corner[i]);
+      bounds.hi[i] = std::max(bounds.hi[i], corner[i] + size);
+    }
+    return;
+  }
+
+  int half = size / 2;
+  uint32_t child = node >> 8;
+  for (int i = 0; i < 8; i++) {
+    if (!(node & (1 << i)))
+      continue;
+    grow(bounds, nodes_[child++],
+      x + (i & 1 ? half : 0),
+      y + (i & 2 ? half : 0),
+      z + (i & 4 ? half : 0),
+      half);
+  }
+}
+
+Octree::Hit Octree::raycast(const float pos[3], const float dir[3], int limit,
+  float start, float end) const {
+  Hit hit { .voxel = 0, .t = end, .normal = {0, 0, 0}, .steps = 0 };
+
+  // clip the ray to the unit cube
+  float inv[3];
+  float t_enter = -INFINITY;
+  float t_exit = INFINITY;
+  int axis = 0;
+  for (int i = 0; i < 3; i++) {
+    inv[i] = 1.f / dir[i];
+    float t0 = -pos[i] * inv[i];
+    float t1 = (1.f - pos[i]) * inv[i];
+    if (std::min(t0, t1) > t_enter) {
+      t_enter = std::min(t0, t1);
+      axis = i;
+    }
+    t_exit = std::min(t_exit, std::max(t0, t1));
+  }
+
+  if (t_enter > t_exit || t_exit < start)
+    return hit;
+
+  float t = std::max(start, t_enter);
+  t_exit = std::min(t_exit, end);
+  float normal[3] = {0, 0, 0};
+  normal[axis] = dir[axis] > 0 ? -1 : 1;
+
+  while (hit.steps < limit && t < t_exit) {
+    hit.steps++;
+
+    // descend to the deepest node containing the current point
+    float p[3];
+    for (int i = 0; i < 3; i++)
+      p[i] = pos[i] + (t + NUDGE) * dir[i];
+
+    uint32_t node = nodes_[0];
+    float lo[3] = {0, 0, 0};
+    float size = 1;
+    while (node != 0 && !(node & LEAF)) {
+      size *= .5;
+      uint32_t octant = 0;
+      for (int i = 0; i < 3; i++) {
+        if (p[i] >= lo[i] + size) {
+          octant |= 1 << i;
+          lo[i] += size;
+        }
+      }
+
+      uint32_t mask = node & 0xff;
+      if (!(mask & (1 << octant))) {
+        node = 0;
+        break;
+      }
+      node = nodes_[(node >> 8) + std::popcount(mask & ((1u << octant) - 1))];
+    }
+
+    if (node != 0) {
+      hit.voxel = node & ~LEAF;
+      hit.t = t;
+      std::copy(normal, normal + 3, hit.normal);
+      return hit;
+    }
+
+    // skip the whole empty cell by jumping to its far side
+    float t_far = INFINITY;
+    for (int i = 0; i < 3; i++) {
+      if (dir[i] == 0)
+        continue;
+      float plane = lo[i] + (dir[i] > 0 ? size : 0);
+      float t_plane = (plane - pos[i]) * inv[i];
+      if (t_plane < t_far) {
+        t_far = t_plane;
+        axis = i;
+      }
+    }
+
+    t = t_far;
+    std::fill(normal, normal + 3, 0);
+    normal[axis] = dir[axis] > 0 ? -1 : 1;
+  }
+
+  return hit;
+}
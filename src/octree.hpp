@@ -0,0 +1,79 @@
+#pragma once
+
+#include "morton.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace vx {
+
+// sparse voxel octree over a cubic grid of voxel types, flattened into a
+// single array of nodes so it can be uploaded to the gpu as is
+//
+// each node is one uint32_t:
+// - 0 is empty space (only ever stored as the root of an empty grid)
+// - a leaf has the high bit set and the voxel type in the low 31 bits; any
+//   octant filled entirely with one type collapses into a single leaf
+// - a branch has a mask of its non-empty octants in the low 8 bits and the
+//   index of its first child in bits 8 to 30, leaving the high bit clear.
+//   only non-empty children are stored, packed in octant order, so child n
+//   of a branch lives at first + popcount(mask & ((1 << n) - 1)). that caps
+//   a tree at 2^23 nodes
+//
+// octant bits are x = 1, y = 2, z = 4. the root is always node 0
+class Octree {
+public:
+  static const uint32_t LEAF = 0x80000000;
+
+  // a half open box of voxels, empty when lo == hi
+  struct Bounds {
+    int lo[3];
+    int hi[3];
+  };
+
+  struct Hit {
+    uint32_t voxel;
+    float t;
+    float normal[3];
+    int steps;
+  };
+
+  Octree() = default;
+
+  // voxels is a count^3 grid indexed [z][y][x], or by morton code, count a
+  // power of two. the build visits voxels in morton order, so a morton grid
+  // is read straight through
+  Octree(const uint32_t *voxels, int count,
+    VoxelLayout layout = VoxelLayout::Linear);
+
+  const std::vector<uint32_t> &nodes() const { return nodes_; }
+  int count() const { return count_; }
+
+  uint32_t at(int x, int y, int z) const;
+
+  // the voxel type filling the size^3 cell holding x, y, z, size a power of
+  // two. a cell of mixed voxels takes the type of some solid one in it, so a
+  // coarse copy of the grid is only empty where the grid is
+  uint32_t at(int x, int y, int z, int size) const;
+
+  // the smallest box holding every solid voxel, found from the leaves so
+  // it's only as slow as the tree is big
+  Bounds bounds() const;
+
+  // cpu mirror of raymarch_svo in shader.slang. the octree spans the unit
+  // cube, so pos and dir are in chunk space
+  Hit raycast(const float pos[3], const float dir[3], int limit, float start,
+    float end) const;
+
+private:
+  std::vector<uint32_t> nodes_;
+  int count_ = 0;
+  VoxelLayout layout = VoxelLayout::Linear;
+  uint32_t next_leaf = 0;
+
+  uint32_t build(const uint32_t *voxels, int x, int y, int z, int size);
+  void grow(Bounds &bounds, uint32_t node, int x, int y, int z,
+    int size) const;
+};
+
+}
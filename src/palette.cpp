@@ -0,0 +1,86 @@
+#include "palette.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace vx;
+
+PalettedVoxels::PalettedVoxels(size_t size)
+  : words ((size + 63) / 64)
+  , size_ (size) { }
+
+PalettedVoxels::PalettedVoxels(const uint32_t *voxels, size_t size)
+  : size_ (size) {
+  // find every distinct type up front so we only pack once at the right width
+  for (size_t i = 0; i < size; i++) {
+    if (std::find(palette_.begin(), palette_.end(), voxels[i]) ==
+        palette_.end())
+      palette_.push_back(voxels[i]);
+  }
+
+  while (bits_ < MAX_BITS && palette_.size() > (size_t(1) << bits_))
+    bits_ *= 2;
+  if (palette_.size() > (size_t(1) << bits_))
+    throw std::length_error("too many voxel types for one palette");
+
+  words.resize((size * bits_ + 63) / 64);
+  for (size_t i = 0; i < size; i++) {
+    auto it = std::find(palette_.begin(), palette_.end(), voxels[i]);
+    set_index(i, it - palette_.begin());
+  }
+}
+
+void PalettedVoxels::set(size_t i, uint32_t voxel) {
+  set_index(i, find_or_add(voxel));
+}
+
+std::vector<uint8_t> PalettedVoxels::gpu_indices() const {
+  std::vector<uint8_t> out(size_ * gpu_index_size());
+  if (gpu_index_size() == 1) {
+    for (size_t i = 0; i < size_; i++)
+      out[i] = index(i);
+  } else {
+    for (size_t i = 0; i < size_; i++) {
+      uint16_t index = this->index(i);
+      std::memcpy(&out[i * 2], &index, 2);
+    }
+  }
+
+  return out;
+}
+
+uint32_t PalettedVoxels::find_or_add(uint32_t voxel) {
+  auto it = std::find(palette_.begin(), palette_.end(), voxel);
+  if (it != palette_.end())
+    return it - palette_.begin();
+
+  if (palette_.size() == (size_t(1) << bits_)) {
+    if (bits_ == MAX_BITS)
+      throw std::length_error("too many voxel types for one palette");
+    repack(bits_ * 2);
+  }
+
+  palette_.push_back(voxel);
+  return palette_.size() - 1;
+}
+
+void PalettedVoxels::set_index(size_t i, uint32_t index) {
+  // widths are all powers of two up to 64, so an index never straddles words
+  size_t bit = i * bits_;
+  uint64_t mask = ((uint64_t(1) << bits_) - 1) << (bit % 64);
+  uint64_t &word = words[bit / 64];
+  word = (word & ~mask) | (uint64_t(index) << (bit % 64));
+}
+
+void PalettedVoxels::repack(int bits) {
+  PalettedVoxels wider;
+  wider.words.resize((size_ * bits + 63) / 64);
+  wider.bits_ = bits;
+  wider.size_ = size_;
+  for (size_t i = 0; i < size_; i++)
+    wider.set_index(i, index(i));
+
+  words = std::move(wider.words);
+  bits_ = bits;
+}
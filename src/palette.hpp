@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vx {
+
+// voxel storage that keeps a palette of the distinct voxel types it holds and
+// stores each voxel as a bit-packed index into that palette. indices start at
+// 1 bit and widen to 2, 4, 8 then 16 bits as new types are added, so a chunk
+// of air and stone costs 1 bit per voxel rather than 32
+//
+// palette entry 0 is always empty, so an index of 0 means air without having
+// to look anything up
+class PalettedVoxels {
+public:
+  static const int MAX_BITS = 16;
+
+  PalettedVoxels() = default;
+
+  // size voxels of air
+  PalettedVoxels(size_t size);
+
+  // packs an existing grid of voxel types
+  PalettedVoxels(const uint32_t *voxels, size_t size);
+
+  uint32_t get(size_t i) const { return palette_[index(i)]; }
+  void set(size_t i, uint32_t voxel);
+
+  uint32_t index(size_t i) const {
+    size_t bit = i * bits_;
+    return (words[bit / 64] >> (bit % 64)) & ((uint64_t(1) << bits_) - 1);
+  }
+
+  const std::vector<uint32_t> &palette() const { return palette_; }
+  int bits() const { return bits_; }
+  size_t size() const { return size_; }
+
+  // resident bytes, including the palette
+  size_t bytes() const {
+    return words.size() * sizeof(words[0]) +
+      palette_.size() * sizeof(palette_[0]);
+  }
+
+  // bytes per voxel the gpu copy needs, which can only be 1 or 2 since
+  // there's no image format narrower than a byte
+  size_t gpu_index_size() const { return bits_ <= 8 ? 1 : 2; }
+
+  // unpacks every index to gpu_index_size bytes, ready to upload
+  std::vector<uint8_t> gpu_indices() const;
+
+private:
+  std::vector<uint64_t> words;
+  std::vector<uint32_t> palette_ { 0 };
+  int bits_ = 1;
+  size_t size_ = 0;
+
+  uint32_t find_or_add(uint32_t voxel);
+  void set_index(size_t i, uint32_t index);
+  void repack(int bits);
+};
+
+}
@@ -0,0 +1,102 @@
+#include "pipeline_cache.hpp"
+#include "device.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace vx;
+
+// where caches go, following the xdg base directory spec
+static std::filesystem::path cache_dir() {
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    return std::filesystem::path(xdg) / "voxels";
+  if (const char *home = std::getenv("HOME"); home && *home)
+    return std::filesystem::path(home) / ".cache" / "voxels";
+  return ".";
+}
+
+PipelineCache::PipelineCache(Device &device)
+  : device (device) {
+  // one file per device and driver, so switching gpus or updating drivers
+  // doesn't throw away the other's cache
+  auto props = device.physical().getProperties2<vk::PhysicalDeviceProperties2,
+    vk::PhysicalDeviceIDProperties>();
+  char part[16];
+  std::snprintf(part, sizeof(part), "%08x",
+    props.get<vk::PhysicalDeviceProperties2>().properties.driverVersion);
+  std::string file = "pipelines-" + std::string(part) + "-";
+  for (auto byte : props.get<vk::PhysicalDeviceIDProperties>().deviceUUID) {
+    std::snprintf(part, sizeof(part), "%02x", byte);
+    file += part;
+  }
+  path = cache_dir() / (file + ".bin");
+
+  auto data = load();
+  warm_ = !data.empty();
+  vk::PipelineCacheCreateInfo info {
+    .initialDataSize = data.size(),
+    .pInitialData = data.data()
+  };
+  cache_ = vk::raii::PipelineCache(device.device(), info);
+}
+
+PipelineCache::~PipelineCache() {
+  try {
+    save();
+  } catch (const std::exception &e) {
+    // losing the cache only costs the next launch some time
+    std::cerr << "could not save pipeline cache: " << e.what() << std::endl;
+  }
+}
+
+void PipelineCache::use_scratch(const std::vector<uint8_t> &data) {
+  vk::PipelineCacheCreateInfo info {
+    .initialDataSize = data.size(),
+    .pInitialData = data.data()
+  };
+  scratch_ = vk::raii::PipelineCache(device.device(), info);
+}
+
+std::vector<char> PipelineCache::load() {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return {};
+  std::vector<char> data((std::istreambuf_iterator<char>(in)),
+    std::istreambuf_iterator<char>());
+
+  // drivers are meant to reject caches that aren't theirs, but not all of
+  // them do, so check the header ourselves. see VkPipelineCacheHeaderVersionOne
+  auto props = device.physical().getProperties();
+  vk::PipelineCacheHeaderVersionOne header;
+  if (data.size() < sizeof(header))
+    return {};
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.headerSize < sizeof(header) ||
+      header.headerVersion != vk::PipelineCacheHeaderVersion::eOne ||
+      header.vendorID != props.vendorID ||
+      header.deviceID != props.deviceID ||
+      header.pipelineCacheUUID != props.pipelineCacheUUID)
+    return {};
+
+  return data;
+}
+
+void PipelineCache::save() {
+  auto data = cache_.getData();
+  std::filesystem::create_directories(path.parent_path());
+
+  // write next to it and rename over it, so a crash halfway through never
+  // leaves a torn cache behind
+  auto temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    if (!out.flush())
+      throw std::runtime_error("could not write " + temp.string());
+  }
+  std::filesystem::rename(temp, path);
+}
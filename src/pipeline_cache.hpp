@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class Device;
+
+// a vk::PipelineCache kept on disk between runs, so pipelines only have to be
+// compiled from scratch the first time on a given device and driver. the file
+// is named after both, checked against the device before it's used and
+// replaced whole when the cache is dropped
+class PipelineCache {
+public:
+  PipelineCache(vx::Device &device);
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache &that) = delete;
+  PipelineCache &operator=(const PipelineCache &that) = delete;
+
+  // whether there was a usable cache on disk to start from
+  bool warm() { return warm_; }
+
+  // time spent creating pipelines through the cache so far
+  double build_ms() { return build_ms_; }
+  void add_build_time(double ms) { build_ms_ += ms; }
+
+  // pipelines are created through the scratch cache instead while there is
+  // one. it starts from data, empty or another cache's, and is never saved,
+  // so builds can be timed from a known start, see Renderer::time_pipelines
+  void use_scratch(const std::vector<uint8_t> &data);
+  void drop_scratch() { scratch_ = nullptr; }
+
+  const vk::raii::PipelineCache &cache() const {
+    return *scratch_ ? scratch_ : cache_;
+  }
+
+private:
+  vx::Device &device;
+  std::filesystem::path path;
+  vk::raii::PipelineCache cache_ = nullptr;
+  vk::raii::PipelineCache scratch_ = nullptr;
+  bool warm_ = false;
+  double build_ms_ = 0;
+
+  std::vector<char> load();
+  void save();
+};
+
+}
@@ -0,0 +1,130 @@
+#include "profiler.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace vx;
+
+std::atomic<bool> Profiler::enabled_ = false;
+
+namespace {
+
+struct Event {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+
+// one producer, the thread that owns it, and one consumer, whoever holds
+// the registry lock in collect
+struct Ring {
+  uint32_t tid;
+  std::string name;
+  std::vector<Event> events = std::vector<Event>(Profiler::RING_SIZE);
+
+  // events ever written and ever read, so head - tail are waiting
+  std::atomic<uint64_t> head = 0;
+  std::atomic<uint64_t> tail = 0;
+  std::atomic<uint64_t> dropped = 0;
+};
+
+struct Registry {
+  std::mutex lock;
+  std::vector<std::shared_ptr<Ring>> rings;
+
+  // everything collected so far, per ring
+  std::vector<std::vector<Event>> collected;
+};
+
+}
+
+static Registry &registry() {
+  static Registry registry;
+  return registry;
+}
+
+// made on a thread's first zone and kept by the registry after the thread is
+// gone, so its zones still make it into the trace. threads that never record
+// anything never pay for one
+static thread_local std::shared_ptr<Ring> thread_ring;
+static thread_local std::string thread_name;
+
+static Ring &ring() {
+  if (!thread_ring) {
+    auto &reg = registry();
+    std::lock_guard guard(reg.lock);
+    thread_ring = std::make_shared<Ring>();
+    thread_ring->tid = reg.rings.size();
+    thread_ring->name = thread_name.empty()
+      ? "thread " + std::to_string(thread_ring->tid) : thread_name;
+    reg.rings.push_back(thread_ring);
+    reg.collected.emplace_back();
+  }
+  return *thread_ring;
+}
+
+void Profiler::name_thread(std::string name) {
+  thread_name = std::move(name);
+  if (thread_ring) {
+    std::lock_guard guard(registry().lock);
+    thread_ring->name = thread_name;
+  }
+}
+
+uint64_t Profiler::now_ns() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+  auto &mine = ring();
+  uint64_t head = mine.head.load(std::memory_order_relaxed);
+  if (head - mine.tail.load(std::memory_order_acquire) == RING_SIZE) {
+    mine.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  mine.events[head % RING_SIZE] = { name, start_ns, end_ns };
+  mine.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::collect() {
+  auto &reg = registry();
+  std::lock_guard guard(reg.lock);
+  for (size_t i = 0; i < reg.rings.size(); i++) {
+    auto &ring = *reg.rings[i];
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+    for (; tail < head; tail++)
+      reg.collected[i].push_back(ring.events[tail % RING_SIZE]);
+    ring.tail.store(tail, std::memory_order_release);
+  }
+}
+
+void Profiler::write_trace(std::ostream &out) {
+  collect();
+
+  auto &reg = registry();
+  std::lock_guard guard(reg.lock);
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  out << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+    "\"args\": {\"name\": \"cpu\"}}";
+  for (size_t i = 0; i < reg.rings.size(); i++) {
+    auto &ring = *reg.rings[i];
+    out << ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+      "\"tid\": " << ring.tid << ", \"args\": {\"name\": \"" << ring.name <<
+      "\", \"dropped\": " << ring.dropped.load() << "}}";
+    for (auto &event : reg.collected[i]) {
+      out << ",\n  {\"name\": \"" << event.name << "\", \"ph\": \"X\", "
+        "\"pid\": 0, \"tid\": " << ring.tid << ", \"ts\": " <<
+        event.start_ns / 1e3 << ", \"dur\": " <<
+        (event.end_ns - event.start_ns) / 1e3 << "}";
+    }
+  }
+  out << "\n]}\n";
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace vx {
+
+// cpu timelines for every thread, written out in chrome's trace event format
+// for perfetto or about:tracing. each thread records its zones into its own
+// ring buffer without locking, and collect moves them somewhere roomier, so
+// a thread that outruns collect only loses its newest zones. off until
+// enabled, when a zone costs one relaxed load. building with VX_NO_PROFILER
+// compiles zones out altogether
+class Profiler {
+public:
+  // zones a thread can record between collects before it starts dropping
+  static const size_t RING_SIZE = 1 << 14;
+
+  static void enable(bool enable) {
+    enabled_.store(enable, std::memory_order_relaxed);
+  }
+
+  static bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // labels the calling thread's track in the trace
+  static void name_thread(std::string name);
+
+  static uint64_t now_ns();
+  static void record(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+  // drains every thread's ring. Renderer calls it once a frame
+  static void collect();
+
+  // collects, then writes everything recorded since enabling
+  static void write_trace(std::ostream &out);
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+// times its own lifetime on the calling thread. name has to outlive the
+// profiler, which string literals do
+class ProfileZone {
+public:
+#ifdef VX_NO_PROFILER
+  ProfileZone(const char *name) { }
+#else
+  ProfileZone(const char *name)
+    : name (Profiler::enabled() ? name : nullptr)
+    , start (this->name ? Profiler::now_ns() : 0) { }
+
+  ~ProfileZone() {
+    if (name)
+      Profiler::record(name, start, Profiler::now_ns());
+  }
+#endif
+
+  ProfileZone(const ProfileZone &that) = delete;
+  ProfileZone &operator=(const ProfileZone &that) = delete;
+
+#ifndef VX_NO_PROFILER
+private:
+  const char *name;
+  uint64_t start;
+#endif
+};
+
+}
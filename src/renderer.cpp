@@ -1,24 +1,98 @@
 #include "renderer.hpp"
 
 #include "camera.hpp"
+#include "chunk.hpp"
+#include "clipmap.hpp"
 #include "shaders.h"
 #include "vulkan/vulkan.hpp"
 #include <vulkan/vulkan_raii.hpp>
 
+#include <chrono>
+#include <iostream>
+
 using namespace vx;
 
+// the most descriptors of each type any one set takes: descriptor_layout's,
+// which create_shader_data's sets also use, the clipmap's, with a sampled
+// image per level, and the composite pass's, with two sampled images
+static std::vector<vk::DescriptorPoolSize> descriptor_sizes() {
+  return {
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eUniformBuffer,
+      .descriptorCount = 1
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eSampledImage,
+      .descriptorCount = Clipmap::LEVELS
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 4
+    }
+  };
+}
+
+// VOXEL_COUNT is constant_id 0 in shader.slang
+static vk::SpecializationMapEntry VOXEL_COUNT_ENTRY {
+  .constantID = 0,
+  .offset = 0,
+  .size = sizeof(uint32_t)
+};
+
+static vk::SpecializationInfo voxel_count_spec(const uint32_t &voxel_count) {
+  return {
+    .mapEntryCount = 1,
+    .pMapEntries = &VOXEL_COUNT_ENTRY,
+    .dataSize = sizeof(voxel_count),
+    .pData = &voxel_count
+  };
+}
+
 Renderer::Renderer(vx::Window &window, vx::Device &device,
   uint32_t descriptor_count)
-  : window_ (window)
+  : window_ (&window)
   , device_ (device)
   , swapchain_ (window, device)
   , pool_ (device.create_command_pool())
   , command_buffers (pool_.create_buffers(Swapchain::MAX_FRAMES_IN_FLIGHT))
+  , uploader_ (device)
+  , pipeline_cache (device)
+  , gpu_timer_ (device, Swapchain::MAX_FRAMES_IN_FLIGHT)
+  , descriptors_ (device.device(), descriptor_sizes(),
+      Swapchain::MAX_FRAMES_IN_FLIGHT)
   , camera_uniforms (*this) {
+  create(descriptor_count);
+}
+
+Renderer::Renderer(vx::Device &device, vk::Extent2D extent,
+  uint32_t descriptor_count)
+  : window_ (nullptr)
+  , device_ (device)
+  , swapchain_ (device, extent)
+  , pool_ (device.create_command_pool())
+  , command_buffers (pool_.create_buffers(Swapchain::MAX_FRAMES_IN_FLIGHT))
+  , uploader_ (device)
+  , pipeline_cache (device)
+  , gpu_timer_ (device, Swapchain::MAX_FRAMES_IN_FLIGHT)
+  , descriptors_ (device.device(), descriptor_sizes(),
+      Swapchain::MAX_FRAMES_IN_FLIGHT)
+  , camera_uniforms (*this) {
+  create(descriptor_count);
+}
+
+void Renderer::create(uint32_t descriptor_count) {
   create_descriptor_layout();
-  create_pipeline();
-  create_descriptor_pool(descriptor_count);
+  create_pipeline_layout();
   create_sync_objs();
+  create_composite_layout();
+  create_clipmap_layout();
+  secondaries.resize(Swapchain::MAX_FRAMES_IN_FLIGHT);
+  traces.resize(Swapchain::MAX_FRAMES_IN_FLIGHT);
+  bindless_ = std::make_unique<Bindless>(*this, descriptor_count);
+  build_pipelines();
+
+  std::cout << "pipelines built in " << pipeline_cache.build_ms() << "ms ("
+    << (pipeline_cache.warm() ? "warm" : "cold") << " cache)" << std::endl;
 }
 
 void Renderer::create_descriptor_layout() {
@@ -32,7 +106,7 @@ void Renderer::create_descriptor_layout() {
     },
     vk::DescriptorSetLayoutBinding {
       .binding = 1,
-      .descriptorType = vk::DescriptorType::eUniformBuffer,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
       .descriptorCount = 1,
       .stageFlags = vk::ShaderStageFlagBits::eVertex |
         vk::ShaderStageFlagBits::eFragment
@@ -42,6 +116,24 @@ void Renderer::create_descriptor_layout() {
       .descriptorType = vk::DescriptorType::eSampledImage,
       .descriptorCount = 1,
       .stageFlags = vk::ShaderStageFlagBits::eFragment
+    },
+    vk::DescriptorSetLayoutBinding {
+      .binding = 3,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
+    },
+    vk::DescriptorSetLayoutBinding {
+      .binding = 4,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
+    },
+    vk::DescriptorSetLayoutBinding {
+      .binding = 5,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
     }
   };
 
@@ -53,19 +145,149 @@ void Renderer::create_descriptor_layout() {
   descriptor_layout = vk::raii::DescriptorSetLayout(device_.device(), info);
 }
 
-void Renderer::create_pipeline() {
+void Renderer::create_pipeline_layout() {
+  // the slot of the chunk being drawn, see push_slot
+  vk::PushConstantRange push_constants {
+    .stageFlags = vk::ShaderStageFlagBits::eVertex |
+      vk::ShaderStageFlagBits::eFragment,
+    .offset = 0,
+    .size = sizeof(uint32_t)
+  };
+
+  // what descriptor sets we can provide to the shaders
+  vk::PipelineLayoutCreateInfo layout_info {
+    .setLayoutCount = 1,
+    .pSetLayouts = &*descriptor_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_constants
+  };
+
+  pipeline_layout = vk::raii::PipelineLayout(device_.device(), layout_info);
+}
+
+void Renderer::create_composite_layout() {
+  std::array bindings {
+    // colour
+    vk::DescriptorSetLayoutBinding {
+      .binding = 0,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
+    },
+    // depth
+    vk::DescriptorSetLayoutBinding {
+      .binding = 1,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
+    }
+  };
+
+  vk::DescriptorSetLayoutCreateInfo info {
+    .bindingCount = bindings.size(),
+    .pBindings = bindings.data(),
+  };
+
+  composite_layout = vk::raii::DescriptorSetLayout(device_.device(), info);
+  composite_pipeline_layout = vk::raii::PipelineLayout(device_.device(),
+    vk::PipelineLayoutCreateInfo {
+      .setLayoutCount = 1,
+      .pSetLayouts = &*composite_layout
+    });
+}
+
+void Renderer::create_clipmap_layout() {
+  std::array bindings {
+    // camera
+    vk::DescriptorSetLayoutBinding {
+      .binding = 0,
+      .descriptorType = vk::DescriptorType::eUniformBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eVertex |
+        vk::ShaderStageFlagBits::eFragment
+    },
+    // levels, finest first
+    vk::DescriptorSetLayoutBinding {
+      .binding = 1,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .descriptorCount = Clipmap::LEVELS,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
+    }
+  };
+
+  vk::DescriptorSetLayoutCreateInfo info {
+    .bindingCount = bindings.size(),
+    .pBindings = bindings.data()
+  };
+
+  // where each level's window starts, see Clipmap::draw
+  vk::PushConstantRange push_constants {
+    .stageFlags = vk::ShaderStageFlagBits::eFragment,
+    .offset = 0,
+    .size = Clipmap::LEVELS * sizeof(glm::ivec4)
+  };
+
+  clipmap_layout_ = vk::raii::DescriptorSetLayout(device_.device(), info);
+  clipmap_pipeline_layout_ = vk::raii::PipelineLayout(device_.device(),
+    vk::PipelineLayoutCreateInfo {
+      .setLayoutCount = 1,
+      .pSetLayouts = &*clipmap_layout_,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_constants
+    });
+}
+
+void Renderer::build_pipelines() {
+  // every pipeline any way of drawing can ask for, so none of them stall the
+  // frame that first needs it. chunks are only ever Chunk::COUNT across in
+  // a given build, so that's the only size specialised for
+  chunk_pipeline(pipeline_layout, shaders, shaders_len, Chunk::COUNT);
+  chunk_pipeline(clipmap_pipeline_layout_, clipmap_shaders,
+    clipmap_shaders_len, Chunk::COUNT);
+  bindless_->build_pipelines(Chunk::COUNT);
+  composite_pipeline = create_graphics_pipeline(composite_pipeline_layout,
+    composite_shaders, composite_shaders_len);
+}
+
+void Renderer::time_pipelines() {
+  // the warm cache is the cold one's data loaded into a new cache, just as
+  // the next launch would load it from disk
+  std::array<double, 2> ms;
+  std::vector<uint8_t> data;
+  for (auto &time : ms) {
+    pipeline_cache.use_scratch(data);
+    variants.clear();
+    double start = pipeline_cache.build_ms();
+    build_pipelines();
+    time = pipeline_cache.build_ms() - start;
+    data = pipeline_cache.cache().getData();
+  }
+  pipeline_cache.drop_scratch();
+
+  std::cout << "pipelines built in " << ms[0] << "ms cold, " << ms[1]
+    << "ms warm, " << ms[0] - ms[1] << "ms saved" << std::endl;
+}
+
+vk::raii::Pipeline Renderer::create_graphics_pipeline(
+  const vk::raii::PipelineLayout &layout,
+  const unsigned char *code,
+  size_t size,
+  const vk::SpecializationInfo *spec
+) {
   // load shader module
-  auto shaders = create_shader_module();
+  auto shaders = create_shader_module(code, size);
   vk::PipelineShaderStageCreateInfo vert_shader {
     .stage = vk::ShaderStageFlagBits::eVertex,
     .module = shaders,
-    .pName = "vert_main"
+    .pName = "vert_main",
+    .pSpecializationInfo = spec
   };
 
   vk::PipelineShaderStageCreateInfo frag_shader {
     .stage = vk::ShaderStageFlagBits::eFragment,
     .module = shaders,
-    .pName = "frag_main"
+    .pName = "frag_main",
+    .pSpecializationInfo = spec
   };
 
   vk::PipelineShaderStageCreateInfo shader_stages[] {
@@ -140,22 +362,6 @@ void Renderer::create_pipeline() {
     .pAttachments = &color_blend_attachment
   };
 
-  // vk::PushConstantRange push_constants {
-  //   .stageFlags = vk::ShaderStageFlagBits::eFragment,
-  //   .offset = 0,
-  //   .size = sizeof(CameraUniforms),
-  // };
-
-  // what descriptor sets we can provide to the shaders
-  vk::PipelineLayoutCreateInfo layout_info {
-    .setLayoutCount = 1,
-    .pSetLayouts = &*descriptor_layout,
-    .pushConstantRangeCount = 0,
-    .pPushConstantRanges = nullptr
-  };
-
-  pipeline_layout = vk::raii::PipelineLayout(device_.device(), layout_info);
-
   // depth and stencil info
   vk::PipelineDepthStencilStateCreateInfo depth_info {
     .depthTestEnable = true,
@@ -177,7 +383,7 @@ void Renderer::create_pipeline() {
       .pDepthStencilState = &depth_info,
       .pColorBlendState = &color_blending,
       .pDynamicState = &dynamic_info,
-      .layout = pipeline_layout,
+      .layout = layout,
       .renderPass = nullptr
     },
     vk::PipelineRenderingCreateInfo {
@@ -187,52 +393,93 @@ void Renderer::create_pipeline() {
     }
   };
 
-  pipeline = vk::raii::Pipeline(device_.device(), nullptr, pipeline_info.get());
+  auto start = std::chrono::steady_clock::now();
+  vk::raii::Pipeline result(device_.device(), pipeline_cache.cache(),
+    pipeline_info.get());
+  pipeline_cache.add_build_time(std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count());
+  return result;
 }
 
-vk::raii::ShaderModule Renderer::create_shader_module() {
-  vk::ShaderModuleCreateInfo shader_info {
-    .codeSize = shaders_len,
-    .pCode = (const uint32_t *) &shaders,
-  };
+const vk::raii::Pipeline &Renderer::chunk_pipeline(
+  const vk::raii::PipelineLayout &layout,
+  const unsigned char *code,
+  size_t size,
+  uint32_t voxel_count
+) {
+  auto key = std::make_tuple(*layout, code, (const char *) nullptr,
+    voxel_count);
+  if (auto it = variants.find(key); it != variants.end())
+    return it->second;
+
+  auto spec = voxel_count_spec(voxel_count);
+  return variants.emplace(key,
+    create_graphics_pipeline(layout, code, size, &spec)).first->second;
+}
 
-  return vk::raii::ShaderModule(device_.device(), shader_info);
+const vk::raii::Pipeline &Renderer::chunk_compute_pipeline(
+  const vk::raii::PipelineLayout &layout,
+  const unsigned char *code,
+  size_t size,
+  const char *entry,
+  uint32_t voxel_count
+) {
+  auto key = std::make_tuple(*layout, code, entry, voxel_count);
+  if (auto it = variants.find(key); it != variants.end())
+    return it->second;
+
+  auto spec = voxel_count_spec(voxel_count);
+  return variants.emplace(key,
+    create_compute_pipeline(layout, code, size, entry, &spec)).first->second;
 }
 
-void Renderer::create_descriptor_pool(uint32_t descriptor_count) {
-  uint32_t count = descriptor_count * Swapchain::MAX_FRAMES_IN_FLIGHT;
-  std::array pool_sizes {
-    vk::DescriptorPoolSize {
-      .type = vk::DescriptorType::eUniformBuffer,
-      .descriptorCount = count * 2
-    },
-    vk::DescriptorPoolSize {
-      .type = vk::DescriptorType::eSampledImage,
-      .descriptorCount = count
-    }
-  };
+void Renderer::bind_chunk_pipeline(uint32_t voxel_count) {
+  command_buffer().bindPipeline(vk::PipelineBindPoint::eGraphics,
+    chunk_pipeline(pipeline_layout, shaders, shaders_len, voxel_count));
+}
 
-  vk::DescriptorPoolCreateInfo pool_info {
-    .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
-    .maxSets = Swapchain::MAX_FRAMES_IN_FLIGHT,
-    .poolSizeCount = pool_sizes.size(),
-    .pPoolSizes = pool_sizes.data()
+vk::raii::Pipeline Renderer::create_compute_pipeline(
+  const vk::raii::PipelineLayout &layout,
+  const unsigned char *code,
+  size_t size,
+  const char *entry,
+  const vk::SpecializationInfo *spec
+) {
+  auto shaders = create_shader_module(code, size);
+  vk::ComputePipelineCreateInfo pipeline_info {
+    .stage = {
+      .stage = vk::ShaderStageFlagBits::eCompute,
+      .module = shaders,
+      .pName = entry,
+      .pSpecializationInfo = spec
+    },
+    .layout = layout
   };
 
-  descriptor_pool = vk::raii::DescriptorPool(device_.device(), pool_info);
+  auto start = std::chrono::steady_clock::now();
+  vk::raii::Pipeline result(device_.device(), pipeline_cache.cache(),
+    pipeline_info);
+  pipeline_cache.add_build_time(std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count());
+  return result;
 }
 
-std::vector<vk::raii::DescriptorSet>
-Renderer::new_descriptor_set() {
-  std::vector<vk::DescriptorSetLayout> layouts (Swapchain::MAX_FRAMES_IN_FLIGHT,
-    descriptor_layout);
-  vk::DescriptorSetAllocateInfo alloc_info {
-    .descriptorPool = descriptor_pool,
-    .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
-    .pSetLayouts = layouts.data()
+vk::raii::ShaderModule Renderer::create_shader_module(
+  const unsigned char *code,
+  size_t size
+) {
+  vk::ShaderModuleCreateInfo shader_info {
+    .codeSize = size,
+    .pCode = (const uint32_t *) code,
   };
 
-  auto sets = device_.device().allocateDescriptorSets(alloc_info);
+  return vk::raii::ShaderModule(device_.device(), shader_info);
+}
+
+std::vector<DescriptorSet> Renderer::new_descriptor_set() {
+  std::vector<DescriptorSet> sets;
+  for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++)
+    sets.push_back(descriptors_.allocate(descriptor_layout));
 
   // set up each descriptor set to point to the right uniform buffer
   for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++) {
@@ -266,15 +513,8 @@ ShaderData Renderer::create_shader_data(Texture &texture) {
     .uniforms = UniformBuffer<UniformData>(*this)
   };
 
-  std::vector<vk::DescriptorSetLayout> layouts (Swapchain::MAX_FRAMES_IN_FLIGHT,
-    descriptor_layout);
-  vk::DescriptorSetAllocateInfo alloc_info {
-    .descriptorPool = descriptor_pool,
-    .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
-    .pSetLayouts = layouts.data()
-  };
-
-  result.descriptor_sets = device_.device().allocateDescriptorSets(alloc_info);
+  for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++)
+    result.descriptor_sets.push_back(descriptors_.allocate(descriptor_layout));
 
   // set up each descriptor set to point to the right uniform buffer
   for (int i = 0; i < Swapchain::MAX_FRAMES_IN_FLIGHT; i++) {
@@ -329,39 +569,85 @@ void Renderer::create_sync_objs() {
       .flags = vk::FenceCreateFlagBits::eSignaled
     });
   }
+
+  // counts frames as they finish on the gpu, see frames_done
+  vk::StructureChain timeline_info {
+    vk::SemaphoreCreateInfo {},
+    vk::SemaphoreTypeCreateInfo {
+      .semaphoreType = vk::SemaphoreType::eTimeline,
+      .initialValue = 0
+    }
+  };
+  frames_done_ = vk::raii::Semaphore(device_.device(), timeline_info.get());
 }
 
 bool Renderer::begin_frame(Camera camera) {
   auto frame_index = swapchain_.frame_index();
 
   // wait on the cpu for the frame in flight to be available
-  while (vk::Result::eTimeout == device_.device().waitForFences(
-    *draw_fences[frame_index], true, UINT64_MAX));
-
-  // acquire the next image and signals the presentation semaphore when its
-  // ready to render to
-  auto [result, iindex] = swapchain_.swapchain().acquireNextImage(
-    UINT64_MAX, *present_done_sems[frame_index], nullptr);
-  image_index = iindex;
-
-  // check validity of swapchain
-  if (result == vk::Result::eErrorOutOfDateKHR) {
-    swapchain_.recreate(window_, device_);
-    return false;
-  } else if (result != vk::Result::eSuccess &&
-      result != vk::Result::eSuboptimalKHR)
-    throw std::runtime_error("failed to acquire swapchain!");
+  {
+    ProfileZone zone("wait for frame");
+    while (vk::Result::eTimeout == device_.device().waitForFences(
+      *draw_fences[frame_index], true, UINT64_MAX));
+  }
+
+  Profiler::collect();
+  uploader_.poll();
+
+  // every frame up to the one that last used this frame in flight is done, so
+  // anything retired before then is safe to destroy
+  while (!retired.empty() &&
+      retired.front().first + Swapchain::MAX_FRAMES_IN_FLIGHT <= frame_count)
+    retired.pop_front();
+  descriptors_.reset(frame_index);
+
+  if (swapchain_.headless()) {
+    // offscreen images belong to their frame in flight, so the fence covers
+    // them too
+    image_index = frame_index;
+  } else {
+    // acquire the next image and signals the presentation semaphore when its
+    // ready to render to
+    ProfileZone zone("acquire image");
+    auto [result, iindex] = swapchain_.swapchain().acquireNextImage(
+      UINT64_MAX, *present_done_sems[frame_index], nullptr);
+    image_index = iindex;
+
+    // check validity of swapchain
+    if (result == vk::Result::eErrorOutOfDateKHR) {
+      swapchain_.recreate(*window_, device_);
+      return false;
+    } else if (result != vk::Result::eSuccess &&
+        result != vk::Result::eSuboptimalKHR)
+      throw std::runtime_error("failed to acquire swapchain!");
+  }
 
   // reset fence for our frame in flight and start drawing
   device_.device().resetFences(*draw_fences[frame_index]);
   command_buffers[frame_index].reset();
+  bindless_->flush();
   begin_recording(frame_index, camera);
   return true;
 }
 
 void Renderer::begin_recording(int frame_index, Camera camera) {
   auto &commands = command_buffers[frame_index];
+  recording.emplace("record commands");
   commands.begin({});
+  gpu_timer_.begin_frame(commands, frame_index);
+  {
+    GpuZone zone(gpu_timer_, "uploads");
+    record_uploads(commands);
+  }
+
+  auto extent = swapchain_.extent();
+  camera_uniforms.upload(frame_index, camera.uniforms(
+    static_cast<float>(extent.width), static_cast<float>(extent.height)));
+}
+
+void Renderer::begin_rendering(bool secondary) {
+  auto &commands = command_buffers[swapchain_.frame_index()];
+  auto transitions = gpu_timer_.begin("transitions");
 
   // prepare the image buffer for rendering colour to it
   transition_image_layout(
@@ -388,6 +674,7 @@ void Renderer::begin_recording(int frame_index, Camera camera) {
     vk::PipelineStageFlagBits2::eEarlyFragmentTests |
       vk::PipelineStageFlagBits2::eLateFragmentTests,
     vk::ImageAspectFlagBits::eDepth);
+  gpu_timer_.end(transitions);
 
   // rendering settings relating to how to render
   vk::ClearValue clear_color = vk::ClearColorValue { 0.f, 0.f, 0.f, 1.f };
@@ -420,7 +707,22 @@ void Renderer::begin_recording(int frame_index, Camera camera) {
     .pDepthAttachment = &depth_attachment_info
   };
 
+  // a render pass instance left to secondaries can't record anything else,
+  // so draw_parallel sets the viewport in each of them instead
+  if (secondary)
+    rendering_info.flags =
+      vk::RenderingFlagBits::eContentsSecondaryCommandBuffers;
+
+  // yippee yippee yay yay rendering!
+  rendering_section = gpu_timer_.begin("rendering");
+  commands.beginRendering(rendering_info);
+  if (!secondary)
+    set_viewport(commands);
+}
+
+void Renderer::set_viewport(vk::raii::CommandBuffer &commands) {
   // our viewport is just the whole image
+  auto extent = swapchain_.extent();
   float width = static_cast<float>(extent.width);
   float height = static_cast<float>(extent.height);
   vk::Viewport viewport {
@@ -432,13 +734,109 @@ void Renderer::begin_recording(int frame_index, Camera camera) {
     .maxDepth = 1.0f
   };
 
-  // yippee yippee yay yay rendering!
-  commands.beginRendering(rendering_info);
   commands.setViewport(0, viewport);
   commands.setScissor(0,
     vk::Rect2D(vk::Offset2D(0, 0), extent));
-  commands.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
-  camera_uniforms.upload(frame_index, camera.uniforms(width, height));
+}
+
+void Renderer::draw_parallel(JobSystem &jobs, size_t count,
+  uint32_t voxel_count,
+  const std::function<void(vk::raii::CommandBuffer &, size_t)> &draw) {
+  if (count == 0)
+    return;
+
+  // a group for each worker and one for this thread, which runs jobs too
+  // while it waits. no two groups share a pool, so whichever threads end up
+  // recording them never touch the same one at once
+  int frame_index = swapchain_.frame_index();
+  auto &mine = secondaries[frame_index];
+  size_t groups = std::min<size_t>(jobs.thread_count() + 1, count);
+  while (mine.size() < groups) {
+    auto pool = device_.create_command_pool();
+    auto commands = pool.create_buffer(vk::CommandBufferLevel::eSecondary);
+    mine.push_back({ std::move(pool), std::move(commands) });
+  }
+
+  // looked up here as the variants map isn't safe to build from workers
+  vk::Pipeline pipeline =
+    *chunk_pipeline(pipeline_layout, shaders, shaders_len, voxel_count);
+
+  // secondaries inherit the attachments begin_rendering set up, and nothing
+  // else, so the viewport and pipeline are set again in each of them
+  vk::StructureChain<vk::CommandBufferInheritanceInfo,
+    vk::CommandBufferInheritanceRenderingInfo> inheritance {
+    {},
+    vk::CommandBufferInheritanceRenderingInfo {
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &swapchain_.format(),
+      .depthAttachmentFormat = swapchain_.depth_format(),
+      .rasterizationSamples = vk::SampleCountFlagBits::e1
+    }
+  };
+
+  std::vector<Job> recorded;
+  for (size_t g = 0; g < groups; g++) {
+    size_t first = count * g / groups;
+    size_t last = count * (g + 1) / groups;
+    recorded.push_back(jobs.spawn([&, g, first, last] {
+      ProfileZone zone("record chunks");
+      auto &commands = mine[g].commands;
+      auto &info = inheritance.get<vk::CommandBufferInheritanceInfo>();
+      commands.begin({
+        .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+          vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+        .pInheritanceInfo = &info
+      });
+      set_viewport(commands);
+      commands.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+      for (size_t i = first; i < last; i++)
+        draw(commands, i);
+      commands.end();
+    }));
+  }
+  jobs.wait(jobs.spawn([] { }, recorded));
+
+  // run in group order, so the draws land in the order they were given
+  std::vector<vk::CommandBuffer> handles;
+  for (size_t g = 0; g < groups; g++)
+    handles.push_back(*mine[g].commands);
+  command_buffer().executeCommands(handles);
+}
+
+void Renderer::record_uploads(vk::raii::CommandBuffer &commands) {
+  if (uploads.empty())
+    return;
+
+  // earlier frames may still be reading what we're about to overwrite
+  auto readers = vk::PipelineStageFlagBits2::eComputeShader |
+    vk::PipelineStageFlagBits2::eVertexShader |
+    vk::PipelineStageFlagBits2::eFragmentShader;
+  vk::MemoryBarrier2 before {
+    .srcStageMask = readers,
+    .srcAccessMask = {},
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferWrite
+  };
+  commands.pipelineBarrier2({
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &before
+  });
+
+  for (auto &record : uploads)
+    record(commands);
+  uploads.clear();
+
+  // and this frame has to see the new data
+  vk::MemoryBarrier2 after {
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = readers,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderRead
+  };
+  commands.pipelineBarrier2({
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &after
+  });
 }
 
 void Renderer::transition_image_layout(
@@ -480,11 +878,20 @@ void Renderer::transition_image_layout(
   commands.pipelineBarrier2(info);
 }
 
-void Renderer::bind_descriptor(std::vector<vk::raii::DescriptorSet> &sets) {
-  auto frame_index = swapchain_.frame_index();
-  auto &commands = command_buffers[frame_index];
+void Renderer::bind_descriptor(std::vector<DescriptorSet> &sets) {
+  bind_descriptor(command_buffer(), sets);
+}
+
+void Renderer::bind_descriptor(vk::raii::CommandBuffer &commands,
+  std::vector<DescriptorSet> &sets) {
   commands.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-    pipeline_layout, 0, *sets[frame_index], nullptr);
+    pipeline_layout, 0, *sets[swapchain_.frame_index()], nullptr);
+}
+
+void Renderer::push_slot(vk::raii::CommandBuffer &commands, uint32_t slot) {
+  commands.pushConstants<uint32_t>(pipeline_layout,
+    vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0,
+    slot);
 }
 
 void Renderer::bind_shader_data(ShaderData &data, UniformData &uniforms) {
@@ -495,47 +902,213 @@ void Renderer::bind_shader_data(ShaderData &data, UniformData &uniforms) {
   data.uniforms.upload(frame_index, uniforms);
 }
 
+void Renderer::create_trace_target(int frame_index) {
+  auto &target = traces[frame_index];
+  if (target)
+    retire(std::move(target));
+
+  auto extent = swapchain_.extent();
+  target = std::make_shared<TraceTarget>();
+  target->extent = extent;
+  device_.create_image(target->color, target->color_mem, extent.width,
+    extent.height, 1, vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal,
+    vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    vk::MemoryPropertyFlagBits::eDeviceLocal);
+  target->color_view = device_.create_view(*target->color,
+    vk::ImageViewType::e2D, vk::Format::eR8G8B8A8Unorm,
+    vk::ImageAspectFlagBits::eColor);
+  device_.create_image(target->depth, target->depth_mem, extent.width,
+    extent.height, 1, vk::Format::eR32Sfloat, vk::ImageTiling::eOptimal,
+    vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    vk::MemoryPropertyFlagBits::eDeviceLocal);
+  target->depth_view = device_.create_view(*target->depth,
+    vk::ImageViewType::e2D, vk::Format::eR32Sfloat,
+    vk::ImageAspectFlagBits::eColor);
+}
+
+TraceTarget &Renderer::begin_trace() {
+  auto frame_index = swapchain_.frame_index();
+  auto &target = traces[frame_index];
+  if (!target || target->extent != swapchain_.extent())
+    create_trace_target(frame_index);
+
+  // nothing from the last time round is kept, so the composite that read it
+  // only has to be done before it's overwritten
+  auto &commands = command_buffers[frame_index];
+  for (vk::Image image : { *target->color, *target->depth }) {
+    transition_image_layout(commands, image,
+      vk::ImageLayout::eUndefined,
+      vk::ImageLayout::eGeneral,
+      {},
+      vk::AccessFlagBits2::eShaderStorageWrite,
+      vk::PipelineStageFlagBits2::eFragmentShader,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::ImageAspectFlagBits::eColor);
+  }
+  return *target;
+}
+
+void Renderer::end_trace() {
+  vk::MemoryBarrier2 written {
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead
+  };
+  command_buffer().pipelineBarrier2({
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &written
+  });
+  traced = true;
+}
+
+void Renderer::composite(vk::raii::CommandBuffer &commands) {
+  GpuZone zone(gpu_timer_, "composite");
+  auto frame_index = swapchain_.frame_index();
+  auto &target = *traces[frame_index];
+
+  // compute writes them as storage images and the composite reads them as
+  // sampled ones, which would otherwise need fragment stores enabled. the
+  // general layout covers both, so they stay in it throughout
+  std::array<vk::DescriptorImageInfo, 2> image_infos {{
+    {
+      .imageView = target.color_view,
+      .imageLayout = vk::ImageLayout::eGeneral
+    },
+    {
+      .imageView = target.depth_view,
+      .imageLayout = vk::ImageLayout::eGeneral
+    },
+  }};
+
+  // a fresh set each frame, so it always points at the target as it is now
+  auto set = descriptors_.allocate_transient(frame_index,
+    *composite_layout);
+  std::array<vk::WriteDescriptorSet, 2> write_sets;
+  for (uint32_t i = 0; i < write_sets.size(); i++) {
+    write_sets[i] = {
+      .dstSet = set,
+      .dstBinding = i,
+      .dstArrayElement = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eSampledImage,
+      .pImageInfo = &image_infos[i]
+    };
+  }
+  device_.device().updateDescriptorSets(write_sets, {});
+
+  // one triangle covering the screen, see shaders/composite.slang
+  commands.bindPipeline(vk::PipelineBindPoint::eGraphics, composite_pipeline);
+  commands.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+    composite_pipeline_layout, 0, set, nullptr);
+  commands.draw(3, 1, 0, 0);
+}
+
 void Renderer::end_frame() {
   auto frame_index = swapchain_.frame_index();
   auto &commands = command_buffers[frame_index];
 
+  // the compute path's frame goes over whatever was rasterised
+  if (traced) {
+    composite(commands);
+    traced = false;
+  }
+
   commands.endRendering();
+  gpu_timer_.end(rendering_section);
+  rendering_section = GpuTimer::NONE;
 
-  // now we want the image buffer to be ready to present
+  // now we want the image buffer to be ready to present, or when headless
+  // to be copied out of by read_frame
+  bool headless = swapchain_.headless();
+  auto present = gpu_timer_.begin("present transition");
   transition_image_layout(
     commands,
     swapchain_.image(image_index),
     vk::ImageLayout::eColorAttachmentOptimal,
-    vk::ImageLayout::ePresentSrcKHR,
+    headless ? vk::ImageLayout::eTransferSrcOptimal
+      : vk::ImageLayout::ePresentSrcKHR,
     vk::AccessFlagBits2::eColorAttachmentWrite,
-    {},
+    headless ? vk::AccessFlagBits2::eTransferRead : vk::AccessFlags2 {},
     vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-    vk::PipelineStageFlagBits2::eBottomOfPipe,
+    headless ? vk::PipelineStageFlagBits2::eTransfer
+      : vk::PipelineStageFlagBits2::eBottomOfPipe,
     vk::ImageAspectFlagBits::eColor
   );
+  gpu_timer_.end(present);
 
+  gpu_timer_.end_frame();
   commands.end();
+  recording.reset();
+
+  // this frame's uploads go to the transfer queue first
+  uint64_t uploaded;
+  {
+    ProfileZone zone("submit uploads");
+    uploaded = uploader_.submit();
+  }
 
-  vk::PipelineStageFlags wait_dst_stage {
-    vk::PipelineStageFlagBits::eColorAttachmentOutput
+  std::array wait_infos {
+    // nothing reading uploaded data can start until it's there
+    vk::SemaphoreSubmitInfo {
+      .semaphore = uploader_.timeline(),
+      .value = uploaded,
+      .stageMask = vk::PipelineStageFlagBits2::eTransfer |
+        vk::PipelineStageFlagBits2::eDrawIndirect |
+        vk::PipelineStageFlagBits2::eVertexShader |
+        vk::PipelineStageFlagBits2::eFragmentShader |
+        vk::PipelineStageFlagBits2::eComputeShader
+    },
+    vk::SemaphoreSubmitInfo {
+      .semaphore = present_done_sems[frame_index],
+      .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput
+    }
+  };
+
+  vk::CommandBufferSubmitInfo command_info {
+    .commandBuffer = commands
+  };
+
+  std::array signal_infos {
+    vk::SemaphoreSubmitInfo {
+      .semaphore = frames_done_,
+      .value = frame_count + 1,
+      .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+    },
+    vk::SemaphoreSubmitInfo {
+      .semaphore = render_done_sems[image_index],
+      .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput
+    }
   };
 
   // - submit a command on the queue that:
-  //   - waits for the presentation semaphore
+  //   - waits for the presentation semaphore and the uploads
   //   - renders to the current buffer in the swapchain
-  //   - signals the rendered semaphore
+  //   - signals the frame count and the rendered semaphore
   //   - signals the draw fence
-  vk::SubmitInfo submit_info {
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &*present_done_sems[frame_index],
-    .pWaitDstStageMask = &wait_dst_stage,
-    .commandBufferCount = 1,
-    .pCommandBuffers = &*commands,
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = &*render_done_sems[image_index]
+  // without a swapchain there's nothing to acquire or present, so only the
+  // uploads are waited on and only the frame count and the fence are
+  // signalled
+  vk::SubmitInfo2 submit_info {
+    .waitSemaphoreInfoCount = headless ? 1u : 2u,
+    .pWaitSemaphoreInfos = wait_infos.data(),
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &command_info,
+    .signalSemaphoreInfoCount = headless ? 1u : 2u,
+    .pSignalSemaphoreInfos = signal_infos.data()
   };
 
-  device_.queue().submit(submit_info, draw_fences[frame_index]);
+  {
+    ProfileZone zone("submit");
+    device_.queue().submit2(submit_info, draw_fences[frame_index]);
+  }
+  frame_count++;
+  last_image = image_index;
+
+  if (headless) {
+    swapchain_.next_frame();
+    return;
+  }
 
   try {
     // - submit a command on the queue that:
@@ -549,19 +1122,23 @@ void Renderer::end_frame() {
       .pImageIndices = &image_index
     };
 
-    auto result = device_.queue().presentKHR(present_info);
+    vk::Result result;
+    {
+      ProfileZone zone("present");
+      result = device_.queue().presentKHR(present_info);
+    }
 
     // check validity of swapchain
     if (result == vk::Result::eErrorOutOfDateKHR ||
         result == vk::Result::eSuboptimalKHR ||
-        window_.has_framebuffer_resized()) {
-      swapchain_.recreate(window_, device_);
+        window_->has_framebuffer_resized()) {
+      swapchain_.recreate(*window_, device_);
     } else if (result != vk::Result::eSuccess)
        throw std::runtime_error("could not present to swapchain image");
   } catch (const vk::SystemError &e) {
     if (e.code().value() == static_cast<int>(vk::Result::eErrorOutOfDateKHR))
     {
-      swapchain_.recreate(window_, device_);
+      swapchain_.recreate(*window_, device_);
       return;
     } else throw;
   }
@@ -569,3 +1146,46 @@ void Renderer::end_frame() {
   // next frame in flight
   swapchain_.next_frame();
 }
+
+std::vector<uint8_t> Renderer::read_frame() {
+  if (!swapchain_.headless())
+    throw std::runtime_error("can only read frames back when headless");
+
+  auto extent = swapchain_.extent();
+  vk::DeviceSize size = 4 * extent.width * extent.height;
+  vx::Allocation mem = nullptr;
+  vk::raii::Buffer buffer = nullptr;
+  device_.create_buffer(buffer, mem, size,
+    vk::BufferUsageFlagBits::eTransferDst,
+    vk::MemoryPropertyFlagBits::eHostVisible |
+    vk::MemoryPropertyFlagBits::eHostCoherent);
+
+  {
+    // end_frame left the image ready for transfers, and this goes on the same
+    // queue after it
+    auto commands = pool_.single_time_commands();
+    commands->copyImageToBuffer(swapchain_.image(last_image),
+      vk::ImageLayout::eTransferSrcOptimal, buffer, vk::BufferImageCopy {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {extent.width, extent.height, 1}
+      });
+
+    vk::MemoryBarrier2 to_host {
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+      .dstAccessMask = vk::AccessFlagBits2::eHostRead
+    };
+    commands->pipelineBarrier2({
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &to_host
+    });
+  }
+
+  auto *pixels = static_cast<const uint8_t *>(mem.mapped());
+  return std::vector<uint8_t>(pixels, pixels + size);
+}
@@ -1,12 +1,26 @@
 #pragma once
 
+#include "bindless.hpp"
 #include "camera.hpp"
+#include "descriptors.hpp"
 #include "device.hpp"
+#include "gpu_timer.hpp"
+#include "jobs.hpp"
+#include "pipeline_cache.hpp"
+#include "profiler.hpp"
 #include "swapchain.hpp"
 #include "texture.hpp"
+#include "uploader.hpp"
 
 #include <vulkan/vulkan_raii.hpp>
 
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -18,11 +32,6 @@ template <typename T>
 class UniformBuffer {
 public:
   UniformBuffer(vx::Renderer &render);
-  ~UniformBuffer() {
-    for (int i = 0; i < mems_.size(); i++) {
-      mems_[i].unmapMemory();
-    }
-  }
 
   // no copy because memory mapped regions are affine
   UniformBuffer<T>(UniformBuffer<T> &that) = delete;
@@ -47,11 +56,11 @@ public:
   }
 
   vk::raii::Buffer &ubo(int frame_index) { return ubos_[frame_index]; }
-  vk::raii::DeviceMemory &mem(int frame_index) { return mems_[frame_index]; }
+  vx::Allocation &mem(int frame_index) { return mems_[frame_index]; }
 
 private:
+  std::vector<vx::Allocation> mems_;
   std::vector<vk::raii::Buffer> ubos_;
-  std::vector<vk::raii::DeviceMemory> mems_;
   std::vector<T *> mapped_;
 
   void swap(UniformBuffer<T> &that) {
@@ -63,50 +72,234 @@ private:
 
 struct UniformData {};
 
+// what the compute path traces into instead of the swapchain, the size of
+// the swapchain and one per frame in flight. see Renderer::begin_trace
+struct TraceTarget {
+  vk::Extent2D extent;
+  vx::Allocation color_mem = nullptr;
+  vk::raii::Image color = nullptr;
+  vk::raii::ImageView color_view = nullptr;
+  vx::Allocation depth_mem = nullptr;
+  vk::raii::Image depth = nullptr;
+  vk::raii::ImageView depth_view = nullptr;
+};
+
 struct ShaderData {
   // no copy because uniform buffers has no copy constructor
   Texture &texture;
-  std::vector<vk::raii::DescriptorSet> descriptor_sets;
+  std::vector<vx::DescriptorSet> descriptor_sets;
   vx::UniformBuffer<UniformData> uniforms;
 };
 
 class Renderer {
 public:
+  // descriptor_count is how many chunks Bindless has room for. descriptor
+  // sets otherwise come from descriptors, which grows as it needs to
   Renderer(vx::Window &window, vx::Device &device, uint32_t descriptor_count);
 
+  // renders offscreen at extent on a headless device, for running without a
+  // display. nothing is presented, so frames are only seen via read_frame
+  Renderer(vx::Device &device, vk::Extent2D extent,
+    uint32_t descriptor_count);
+
   ShaderData create_shader_data(Texture &texture);
 
-  std::vector<vk::raii::DescriptorSet> new_descriptor_set();
+  // a set of descriptor_layout per frame in flight, with the camera bound
+  std::vector<vx::DescriptorSet> new_descriptor_set();
 
+  // waits for the frame in flight and starts recording it. compute work can
+  // be recorded until begin_rendering, which starts drawing to the swapchain
+  // and leaves binding a pipeline to the caller. with secondary, everything
+  // drawn until end_frame has to go through draw_parallel instead
   bool begin_frame(Camera camera);
-  void bind_descriptor(std::vector<vk::raii::DescriptorSet> &sets);
+  void begin_rendering(bool secondary = false);
+  void bind_descriptor(std::vector<vx::DescriptorSet> &sets);
+  void bind_descriptor(vk::raii::CommandBuffer &commands,
+    std::vector<vx::DescriptorSet> &sets);
+
+  // which of Bindless's transforms the per chunk shaders draw with
+  void push_slot(vk::raii::CommandBuffer &commands, uint32_t slot);
+
+  // records count draws split into a group per thread on jobs, each into its
+  // own secondary command buffer with the viewport and voxel_count's chunk
+  // pipeline already set, then runs them in order. draw is called once per
+  // index and from several threads at once, so it can only touch what's its
+  // own. after begin_rendering(true)
+  void draw_parallel(vx::JobSystem &jobs, size_t count, uint32_t voxel_count,
+    const std::function<void(vk::raii::CommandBuffer &, size_t)> &draw);
   void bind_shader_data(ShaderData &data, UniformData &uniforms);
+
+  // for drawing with compute rather than rasterising. between begin_frame
+  // and begin_rendering, begin_trace readies this frame's TraceTarget for
+  // storage writes from compute shaders, and end_trace hands it over to
+  // end_frame, which composites it over whatever was rasterised, depth and
+  // all. everything in the target is written again every frame
+  vx::TraceTarget &begin_trace();
+  void end_trace();
+
   void end_frame();
 
+  // how long the gpu spent on the last frame begin_frame waited for. empty
+  // if the graphics queue can't be timed or that frame in flight hadn't run
+  // yet. see gpu_timer for the sections of it
+  std::optional<double> gpu_frame_ms() { return gpu_timer_.frame_ms(); }
+
+  // waits for the last frame ended when headless and copies it back, as
+  // tightly packed rows of rgba8 pixels from the top left
+  std::vector<uint8_t> read_frame();
+
+  // keeps a resource alive until every frame that might still be using it has
+  // finished on the gpu, then drops it
+  void retire(std::shared_ptr<void> resource) {
+    retired.emplace_back(frame_count, std::move(resource));
+  }
+
+  // records copies into the next frame's command buffer ahead of rendering,
+  // so every upload in a frame shares one submit. the copies are fenced off
+  // from the shader reads of earlier frames and of this one, but any image
+  // layout transitions are up to the caller. this is for resources frames in
+  // flight may be reading; new ones should go through uploader
+  void upload(std::function<void(vk::raii::CommandBuffer &)> record) {
+    uploads.push_back(std::move(record));
+  }
+
+  // a pipeline drawing chunk cubes to the swapchain, with its vert_main and
+  // frag_main from the given spir-v, specialised with spec if there is one
+  vk::raii::Pipeline create_graphics_pipeline(
+    const vk::raii::PipelineLayout &layout,
+    const unsigned char *code,
+    size_t size,
+    const vk::SpecializationInfo *spec = nullptr);
+
+  // create_graphics_pipeline with the shader's VOXEL_COUNT fixed to
+  // voxel_count, so the raymarch is compiled for one size of chunk. each
+  // variant is built the first time it's asked for and kept after that
+  const vk::raii::Pipeline &chunk_pipeline(
+    const vk::raii::PipelineLayout &layout,
+    const unsigned char *code,
+    size_t size,
+    uint32_t voxel_count);
+
+  // binds the per chunk pipeline for chunks voxel_count voxels across, after
+  // begin_rendering
+  void bind_chunk_pipeline(uint32_t voxel_count);
+
+  // a compute pipeline running entry from the given spir-v, specialised
+  // with spec if there is one
+  vk::raii::Pipeline create_compute_pipeline(
+    const vk::raii::PipelineLayout &layout,
+    const unsigned char *code,
+    size_t size,
+    const char *entry,
+    const vk::SpecializationInfo *spec = nullptr);
+
+  // create_compute_pipeline specialised and kept like chunk_pipeline
+  const vk::raii::Pipeline &chunk_compute_pipeline(
+    const vk::raii::PipelineLayout &layout,
+    const unsigned char *code,
+    size_t size,
+    const char *entry,
+    uint32_t voxel_count);
+
+  void transition_image_layout(
+    vk::raii::CommandBuffer &commands,
+    const vk::Image &image,
+    vk::ImageLayout old_layout,
+    vk::ImageLayout new_layout,
+    vk::AccessFlags2 src_access,
+    vk::AccessFlags2 dst_access,
+    vk::PipelineStageFlags2 src_stage,
+    vk::PipelineStageFlags2 dst_stage,
+    vk::ImageAspectFlags aspect_mask);
+
+  // builds every pipeline again twice, from an empty cache and then from
+  // what that left behind, and prints how long each took. before the first
+  // frame only, as the pipelines built at startup are replaced
+  void time_pipelines();
+
   float aspect_ratio() {
     return static_cast<float>(swapchain_.extent().width) /
       static_cast<float>(swapchain_.extent().height);
   }
 
-  vx::Window &window() { return window_; }
+  vx::Window &window() { return *window_; }
   vx::Device &device() { return device_; }
   vx::Swapchain &swapchain() { return swapchain_; }
   vx::CommandPool &pool() { return pool_; }
+  vx::Uploader &uploader() { return uploader_; }
+
+  // reaches n once the nth frame submitted has finished on the gpu. uploads
+  // overwriting what frames may still be reading wait on it reaching
+  // frames_submitted, see Uploader::after
+  vk::Semaphore frames_done() { return *frames_done_; }
+  uint64_t frames_submitted() const { return frame_count; }
+
+  // transient sets from this are good until the frame in flight comes round
+  // again, when begin_frame resets them
+  vx::DescriptorAllocator &descriptors() { return descriptors_; }
+
+  // anything recorded between begin_frame and end_frame can be timed with a
+  // GpuZone on this
+  vx::GpuTimer &gpu_timer() { return gpu_timer_; }
+  vx::Bindless &bindless() { return *bindless_; }
+  const vk::raii::DescriptorSetLayout &clipmap_layout() {
+    return clipmap_layout_;
+  }
+  const vk::raii::PipelineLayout &clipmap_pipeline_layout() {
+    return clipmap_pipeline_layout_;
+  }
+  vk::raii::Buffer &camera_ubo(int frame_index) {
+    return camera_uniforms.ubo(frame_index);
+  }
   vk::raii::CommandBuffer &command_buffer() {
     return command_buffers[swapchain_.frame_index()];
   }
 
 private:
-  vx::Window &window_;
+  // null when headless
+  vx::Window *window_;
   vx::Device &device_;
   vx::Swapchain swapchain_;
   vx::CommandPool pool_;
   std::vector<vk::raii::CommandBuffer> command_buffers;
+  vx::Uploader uploader_;
+  vx::PipelineCache pipeline_cache;
+  vx::GpuTimer gpu_timer_;
+
+  // draw_parallel's secondary command buffers by frame in flight then group,
+  // each with a pool of its own as pools can't be shared between threads
+  struct Secondary {
+    vx::CommandPool pool;
+    vk::raii::CommandBuffer commands;
+  };
+  std::vector<std::vector<Secondary>> secondaries;
+
+  // open from begin_rendering to end_frame
+  uint32_t rendering_section = GpuTimer::NONE;
+
+  // open from begin_frame to end_frame
+  std::optional<ProfileZone> recording;
 
   vk::raii::DescriptorSetLayout descriptor_layout = nullptr;
-  vk::raii::DescriptorPool descriptor_pool = nullptr;
+  vx::DescriptorAllocator descriptors_;
   vk::raii::PipelineLayout pipeline_layout = nullptr;
-  vk::raii::Pipeline pipeline = nullptr;
+
+  // chunk_pipeline's and chunk_compute_pipeline's variants, by layout,
+  // spir-v, compute entry point (null for graphics) and voxel count
+  std::map<std::tuple<VkPipelineLayout, const unsigned char *, const char *,
+    uint32_t>, vk::raii::Pipeline> variants;
+
+  // begin_trace's targets, recreated whenever the swapchain changes size,
+  // and the pass that end_frame composites them with
+  std::vector<std::shared_ptr<vx::TraceTarget>> traces;
+  vk::raii::DescriptorSetLayout composite_layout = nullptr;
+  vk::raii::PipelineLayout composite_pipeline_layout = nullptr;
+  vk::raii::Pipeline composite_pipeline = nullptr;
+  bool traced = false;
+
+  // Clipmap's layouts, kept here so its pipeline is built with the rest
+  vk::raii::DescriptorSetLayout clipmap_layout_ = nullptr;
+  vk::raii::PipelineLayout clipmap_pipeline_layout_ = nullptr;
 
   // camera
   vx::UniformBuffer<CameraUniforms> camera_uniforms;
@@ -114,27 +307,36 @@ private:
   std::vector<vk::raii::Semaphore> render_done_sems;
   std::vector<vk::raii::Semaphore> present_done_sems;
   std::vector<vk::raii::Fence> draw_fences;
+  vk::raii::Semaphore frames_done_ = nullptr;
 
   uint32_t image_index;
+  uint32_t last_image = 0;
+
+  // declared before retired, as retired slots go back to it when dropped
+  std::unique_ptr<vx::Bindless> bindless_;
 
+  // number of frames submitted so far, used to age retired resources
+  uint64_t frame_count = 0;
+  std::deque<std::pair<uint64_t, std::shared_ptr<void>>> retired;
+
+  std::vector<std::function<void(vk::raii::CommandBuffer &)>> uploads;
+
+  void create(uint32_t descriptor_count);
   void create_descriptor_layout();
-  void create_pipeline();
-  vk::raii::ShaderModule create_shader_module();
-  void create_descriptor_pool(uint32_t descriptor_count);
+  void create_pipeline_layout();
+  void create_composite_layout();
+  void create_clipmap_layout();
+  void build_pipelines();
+  void create_trace_target(int frame_index);
+  vk::raii::ShaderModule create_shader_module(const unsigned char *code,
+    size_t size);
   void create_descriptor_sets();
   void create_sync_objs();
 
   void begin_recording(int frame_index, Camera camera);
-  void transition_image_layout(
-    vk::raii::CommandBuffer &commands,
-    const vk::Image &image,
-    vk::ImageLayout old_layout,
-    vk::ImageLayout new_layout,
-    vk::AccessFlags2 src_access,
-    vk::AccessFlags2 dst_access,
-    vk::PipelineStageFlags2 src_stage,
-    vk::PipelineStageFlags2 dst_stage,
-    vk::ImageAspectFlags aspect_mask);
+  void set_viewport(vk::raii::CommandBuffer &commands);
+  void record_uploads(vk::raii::CommandBuffer &commands);
+  void composite(vk::raii::CommandBuffer &commands);
 };
 
 template<typename T>
@@ -151,8 +353,7 @@ UniformBuffer<T>::UniformBuffer(Renderer &render) {
       vk::BufferUsageFlagBits::eUniformBuffer,
       vk::MemoryPropertyFlagBits::eHostVisible |
       vk::MemoryPropertyFlagBits::eHostCoherent);
-    void *data = mems_[i].mapMemory(0, size, {});
-    mapped_.push_back(reinterpret_cast<T *>(data));
+    mapped_.push_back(reinterpret_cast<T *>(mems_[i].mapped()));
   }
 }
 
@@ -0,0 +1,106 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+using namespace vx;
+
+Percentiles vx::percentiles(std::vector<double> samples) {
+  if (samples.empty())
+    return {};
+
+  std::sort(samples.begin(), samples.end());
+  auto rank = [&](double p) {
+    size_t i = static_cast<size_t>(std::ceil(p * samples.size()));
+    return samples[std::clamp<size_t>(i, 1, samples.size()) - 1];
+  };
+
+  return {
+    .min = samples.front(),
+    .avg = std::accumulate(samples.begin(), samples.end(), 0.) /
+      samples.size(),
+    .p50 = rank(.5),
+    .p95 = rank(.95),
+    .p99 = rank(.99),
+    .max = samples.back()
+  };
+}
+
+static void write_percentiles(std::ostream &out,
+  const std::vector<double> &samples) {
+  if (samples.empty()) {
+    out << "null";
+    return;
+  }
+
+  auto p = percentiles(samples);
+  out << "{\"min\": " << p.min << ", \"avg\": " << p.avg << ", \"p50\": " <<
+    p.p50 << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 <<
+    ", \"max\": " << p.max << "}";
+}
+
+void ReplayResult::write_json(std::ostream &out,
+  const std::vector<std::pair<const char *, double>> &info) const {
+  out << "{\n";
+  for (auto &[key, value] : info)
+    out << "  \"" << key << "\": " << value << ",\n";
+  out << "  \"step\": " << step << ",\n";
+  out << "  \"frames\": " << cpu_ms.size() << ",\n";
+  out << "  \"cpu_ms\": ";
+  write_percentiles(out, cpu_ms);
+  out << ",\n  \"gpu_ms\": ";
+  write_percentiles(out, gpu_ms);
+  out << ",\n  \"gpu_sections\": {";
+  const char *separator = "\n";
+  for (auto &[name, stats] : sections) {
+    out << separator << "    \"" << name << "\": {\"count\": " <<
+      stats.count << ", \"avg\": " << stats.avg_ms() << ", \"min\": " <<
+      stats.min_ms << ", \"max\": " << stats.max_ms << "}";
+    separator = ",\n";
+  }
+  out << (sections.empty() ? "}" : "\n  }") << "\n}\n";
+}
+
+// keeps updating the world until nothing around the camera is left to load
+static void settle(Renderer &render, World &world, const Camera &camera) {
+  world.update(render, camera);
+  while (world.stats().pending > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    world.update(render, camera);
+  }
+}
+
+ReplayResult vx::replay(Renderer &render, World &world, Camera &camera,
+  const CameraPath &path, float step,
+  const std::function<bool()> &after_frame) {
+  ReplayResult result { .step = step };
+  int frames = static_cast<int>(path.duration() / step) + 1;
+  for (int i = 0; i < frames; i++) {
+    auto key = path.sample(i * step);
+    camera.set_pose(key.pos, key.yaw, key.pitch);
+    settle(render, world, camera);
+
+    auto start = std::chrono::steady_clock::now();
+    if (!render.begin_frame(camera)) {
+      // the swapchain was recreated, so try this frame again
+      i--;
+      continue;
+    }
+
+    if (auto gpu = render.gpu_frame_ms())
+      result.gpu_ms.push_back(*gpu);
+    world.render(render);
+    render.end_frame();
+    result.cpu_ms.push_back(std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count());
+
+    if (after_frame && !after_frame())
+      break;
+  }
+
+  result.sections = render.gpu_timer().stats();
+  return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "camera.hpp"
+#include "camera_path.hpp"
+#include "renderer.hpp"
+#include "world.hpp"
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vx {
+
+struct Percentiles {
+  double min, avg, p50, p95, p99, max;
+};
+
+// nearest rank percentiles of samples, all zero if there are none
+Percentiles percentiles(std::vector<double> samples);
+
+struct ReplayResult {
+  float step;
+
+  // cpu time is from the start of Renderer::begin_frame to the end of
+  // end_frame, fence wait included. gpu times come in a couple of frames
+  // late, so the last frames in flight go without
+  std::vector<double> cpu_ms;
+  std::vector<double> gpu_ms;
+
+  // Renderer::gpu_timer's sections over the run
+  std::map<std::string, vx::GpuSectionStats> sections;
+
+  // as json, with info about the run added at the top level
+  void write_json(std::ostream &out,
+    const std::vector<std::pair<const char *, double>> &info) const;
+};
+
+// flies the camera along path, one frame every step seconds of path time
+// however long the frames really take. before each frame the world is left
+// to load everything around the camera, so every run draws the same chunks
+// and streaming doesn't muddy the timings. after_frame is called after each
+// frame, returning false to stop early
+ReplayResult replay(vx::Renderer &render, vx::World &world,
+  vx::Camera &camera, const vx::CameraPath &path, float step = 1.f / 60,
+  const std::function<bool()> &after_frame = {});
+
+}
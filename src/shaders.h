@@ -4,4 +4,20 @@
 extern unsigned char shaders[];
 extern unsigned int shaders_len;
 
+// the same shaders built with BINDLESS defined
+extern unsigned char bindless_shaders[];
+extern unsigned int bindless_shaders_len;
+
+// and with GRID defined as well
+extern unsigned char grid_shaders[];
+extern unsigned int grid_shaders_len;
+
+// and with CLIPMAP defined
+extern unsigned char clipmap_shaders[];
+extern unsigned int clipmap_shaders_len;
+
+// Renderer::begin_trace's composite pass, from composite.slang
+extern unsigned char composite_shaders[];
+extern unsigned int composite_shaders_len;
+
 #endif /* SHADERS_H */
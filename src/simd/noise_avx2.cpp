@@ -0,0 +1,79 @@
+// avx2 build of the noise kernels, compiled with -mavx2 and only called once
+// best_isa has checked the cpu supports it
+#include "../noise.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace {
+
+struct Vm {
+  __m256 v;
+};
+
+struct Vf {
+  __m256 v;
+  Vf(__m256 v) : v (v) { }
+  Vf(float v) : v (_mm256_set1_ps(v)) { }
+};
+
+struct Vi {
+  __m256i v;
+  Vi(__m256i v) : v (v) { }
+  Vi(uint32_t v) : v (_mm256_set1_epi32(static_cast<int>(v))) { }
+};
+
+inline Vf operator+(Vf a, Vf b) { return _mm256_add_ps(a.v, b.v); }
+inline Vf operator-(Vf a, Vf b) { return _mm256_sub_ps(a.v, b.v); }
+inline Vf operator*(Vf a, Vf b) { return _mm256_mul_ps(a.v, b.v); }
+inline Vi operator+(Vi a, Vi b) { return _mm256_add_epi32(a.v, b.v); }
+inline Vi operator*(Vi a, Vi b) { return _mm256_mullo_epi32(a.v, b.v); }
+inline Vi operator^(Vi a, Vi b) { return _mm256_xor_si256(a.v, b.v); }
+inline Vi operator&(Vi a, Vi b) { return _mm256_and_si256(a.v, b.v); }
+inline Vm operator~(Vm a) {
+  return {_mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))};
+}
+inline Vm operator&(Vm a, Vm b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline Vm operator|(Vm a, Vm b) { return {_mm256_or_ps(a.v, b.v)}; }
+
+inline Vf floor(Vf a) { return _mm256_floor_ps(a.v); }
+inline Vf max(Vf a, Vf b) { return _mm256_max_ps(a.v, b.v); }
+inline Vi to_int(Vf a) { return _mm256_cvttps_epi32(a.v); }
+inline Vi srl(Vi a, int n) {
+  return _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n));
+}
+inline Vm less(Vi a, Vi b) {
+  return {_mm256_castsi256_ps(_mm256_cmpgt_epi32(b.v, a.v))};
+}
+inline Vm eq(Vi a, Vi b) {
+  return {_mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v))};
+}
+inline Vm ge(Vf a, Vf b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline Vf select(Vm m, Vf a, Vf b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+inline Vi select(Vm m, Vi a, Vi b) {
+  return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v),
+    _mm256_castsi256_ps(a.v), m.v));
+}
+
+}
+
+#include "../noise_kernels.hpp"
+
+using namespace vx;
+
+void vx::perlin8_avx2(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out) {
+  Vf n = kernels::perlin(Vf(_mm256_loadu_ps(x)), Vf(_mm256_loadu_ps(y)),
+    Vf(_mm256_loadu_ps(z)), Vi(seed));
+  _mm256_storeu_ps(out, n.v);
+}
+
+void vx::simplex8_avx2(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out) {
+  Vf n = kernels::simplex(Vf(_mm256_loadu_ps(x)), Vf(_mm256_loadu_ps(y)),
+    Vf(_mm256_loadu_ps(z)), Vi(seed));
+  _mm256_storeu_ps(out, n.v);
+}
+
+#endif
@@ -0,0 +1,81 @@
+// sse4.1 build of the noise kernels, compiled with -msse4.1 and only called
+// once best_isa has checked the cpu supports it
+#include "../noise.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+
+namespace {
+
+struct Vm {
+  __m128 v;
+};
+
+struct Vf {
+  __m128 v;
+  Vf(__m128 v) : v (v) { }
+  Vf(float v) : v (_mm_set1_ps(v)) { }
+};
+
+struct Vi {
+  __m128i v;
+  Vi(__m128i v) : v (v) { }
+  Vi(uint32_t v) : v (_mm_set1_epi32(static_cast<int>(v))) { }
+};
+
+inline Vf operator+(Vf a, Vf b) { return _mm_add_ps(a.v, b.v); }
+inline Vf operator-(Vf a, Vf b) { return _mm_sub_ps(a.v, b.v); }
+inline Vf operator*(Vf a, Vf b) { return _mm_mul_ps(a.v, b.v); }
+inline Vi operator+(Vi a, Vi b) { return _mm_add_epi32(a.v, b.v); }
+inline Vi operator*(Vi a, Vi b) { return _mm_mullo_epi32(a.v, b.v); }
+inline Vi operator^(Vi a, Vi b) { return _mm_xor_si128(a.v, b.v); }
+inline Vi operator&(Vi a, Vi b) { return _mm_and_si128(a.v, b.v); }
+inline Vm operator~(Vm a) {
+  return {_mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1)))};
+}
+inline Vm operator&(Vm a, Vm b) { return {_mm_and_ps(a.v, b.v)}; }
+inline Vm operator|(Vm a, Vm b) { return {_mm_or_ps(a.v, b.v)}; }
+
+inline Vf floor(Vf a) { return _mm_floor_ps(a.v); }
+inline Vf max(Vf a, Vf b) { return _mm_max_ps(a.v, b.v); }
+inline Vi to_int(Vf a) { return _mm_cvttps_epi32(a.v); }
+inline Vi srl(Vi a, int n) { return _mm_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+inline Vm less(Vi a, Vi b) {
+  return {_mm_castsi128_ps(_mm_cmplt_epi32(a.v, b.v))};
+}
+inline Vm eq(Vi a, Vi b) {
+  return {_mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v))};
+}
+inline Vm ge(Vf a, Vf b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline Vf select(Vm m, Vf a, Vf b) { return _mm_blendv_ps(b.v, a.v, m.v); }
+inline Vi select(Vm m, Vi a, Vi b) {
+  return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v),
+    _mm_castsi128_ps(a.v), m.v));
+}
+
+}
+
+#include "../noise_kernels.hpp"
+
+using namespace vx;
+
+void vx::perlin8_sse41(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out) {
+  for (int i = 0; i < 8; i += 4) {
+    Vf n = kernels::perlin(Vf(_mm_loadu_ps(x + i)), Vf(_mm_loadu_ps(y + i)),
+      Vf(_mm_loadu_ps(z + i)), Vi(seed));
+    _mm_storeu_ps(out + i, n.v);
+  }
+}
+
+void vx::simplex8_sse41(const float *x, const float *y, const float *z,
+  uint32_t seed, float *out) {
+  for (int i = 0; i < 8; i += 4) {
+    Vf n = kernels::simplex(Vf(_mm_loadu_ps(x + i)), Vf(_mm_loadu_ps(y + i)),
+      Vf(_mm_loadu_ps(z + i)), Vi(seed));
+    _mm_storeu_ps(out + i, n.v);
+  }
+}
+
+#endif
@@ -10,6 +10,12 @@ Swapchain::Swapchain(Window &window, Device &device) {
   create_depth_resources(device);
 }
 
+Swapchain::Swapchain(Device &device, vk::Extent2D extent) {
+  create_offscreen(device, extent);
+  create_views(device);
+  create_depth_resources(device);
+}
+
 void Swapchain::recreate(Window &window, Device &device) {
   int width, height;
   window.fb_size(width, height);
@@ -67,6 +73,23 @@ void Swapchain::create_swapchain(Window &window, Device &device) {
   extent_ = extent;
 }
 
+void Swapchain::create_offscreen(Device &device, vk::Extent2D extent) {
+  // rgba rather than the bgra windows tend to want, so frames read back in
+  // the order image files expect
+  format_ = vk::Format::eR8G8B8A8Srgb;
+  extent_ = extent;
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    offscreen_images.push_back(nullptr);
+    offscreen_mems.push_back(nullptr);
+    device.create_image(offscreen_images[i], offscreen_mems[i], extent.width,
+      extent.height, 1, format_, vk::ImageTiling::eOptimal,
+      vk::ImageUsageFlagBits::eColorAttachment |
+      vk::ImageUsageFlagBits::eTransferSrc,
+      vk::MemoryPropertyFlagBits::eDeviceLocal);
+    images.push_back(*offscreen_images[i]);
+  }
+}
+
 vk::SurfaceFormatKHR Swapchain::choose_format(
   const std::vector<vk::SurfaceFormatKHR> &formats
 ) {
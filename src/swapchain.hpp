@@ -11,6 +11,12 @@ class Swapchain {
 public:
   Swapchain(Window &window, Device &device);
 
+  // renders into images of our own rather than a window's, one per frame in
+  // flight, which are left ready to copy out of at the end of each frame
+  Swapchain(Device &device, vk::Extent2D extent);
+
+  bool headless() { return !*swapchain_; }
+
   static const int MAX_FRAMES_IN_FLIGHT = 2;
 
   bool has_stencil();
@@ -23,7 +29,7 @@ public:
   vk::Extent2D &extent() { return extent_; }
   uint32_t frame_index() { return findex; }
   vk::raii::Image &depth_image() { return depth_image_; }
-  vk::raii::DeviceMemory &depth_mem() { return depth_mem_; }
+  vx::Allocation &depth_mem() { return depth_mem_; }
   vk::raii::ImageView &depth_view() { return depth_view_; }
   vk::Format &depth_format() { return depth_format_; }
 
@@ -34,16 +40,21 @@ private:
   vk::raii::SwapchainKHR swapchain_ = nullptr;
   std::vector<vk::Image> images;
   std::vector<vk::raii::ImageView> image_views;
+
+  // backing the images when headless
+  std::vector<vx::Allocation> offscreen_mems;
+  std::vector<vk::raii::Image> offscreen_images;
   vk::Format format_;
   vk::Extent2D extent_;
   uint32_t findex = 0;
 
+  vx::Allocation depth_mem_ = nullptr;
   vk::raii::Image depth_image_ = nullptr;
-  vk::raii::DeviceMemory depth_mem_ = nullptr;
   vk::raii::ImageView depth_view_ = nullptr;
   vk::Format depth_format_;
 
   void create_swapchain(vx::Window &window, vx::Device &device);
+  void create_offscreen(vx::Device &device, vk::Extent2D extent);
   void create_views(Device &device);
   void create_depth_resources(Device &device);
 
@@ -0,0 +1,84 @@
+#include "terrain.hpp"
+
+#include <algorithm>
+
+using namespace vx;
+
+void SphereGenerator::generate(int x, int y, int z, int count,
+  uint32_t *voxels) const {
+  // generate a sphere
+  float radius_sq = (float) (count - 1) / 2. * (float) (count - 1) / 2.;
+  float c = (float) count / 2.;
+
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < count; j++) {
+      for (int k = 0; k < count; k++) {
+        float i_ = (float) i;
+        float j_ = (float) j;
+        float k_ = (float) k;
+        float dist = (i_ - c) * (i_ - c) + (j_ - c) * (j_ - c) +
+          (k_ - c) * (k_ - c);
+        uint32_t &voxel = voxels[(i * count + j) * count + k];
+        if (dist < radius_sq) {
+          if ((i + j + k) & 1)
+            voxel = VoxelType::Light;
+          else voxel = VoxelType::Dark;
+        } else voxel = VoxelType::Empty;
+      }
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < count; j++) {
+      if ((i + j) & 1)
+        voxels[i * count * count + j] = VoxelType::Light;
+      else voxels[i * count * count + j] = VoxelType::Dark;
+    }
+  }
+}
+
+NoiseGenerator::NoiseGenerator(NoiseParams params, Isa isa)
+  : params (params)
+  , noise (noise8(params.kernel, isa)) { }
+
+void NoiseGenerator::generate(int x, int y, int z, int count,
+  uint32_t *voxels) const {
+  alignas(32) float xs[8], ys[8], zs[8], n[8], density[8];
+  float inv_scale = 1.f / params.scale;
+
+  for (int k = 0; k < count; k++) {
+    int wz = z * count + k;
+    for (int j = 0; j < count; j++) {
+      int wy = y * count + j;
+
+      // rows are done 8 voxels at a time, with the tail of rows that aren't
+      // a multiple of 8 padded out and thrown away
+      for (int i = 0; i < count; i += 8) {
+        std::fill(density, density + 8, 0.f);
+        float freq = inv_scale;
+        float amplitude = params.height;
+        for (int octave = 0; octave < params.octaves; octave++) {
+          for (int l = 0; l < 8; l++) {
+            xs[l] = (x * count + i + l) * freq;
+            ys[l] = wy * freq;
+            zs[l] = wz * freq;
+          }
+
+          noise(xs, ys, zs, params.seed + octave, n);
+          for (int l = 0; l < 8; l++)
+            density[l] += n[l] * amplitude;
+          freq *= 2;
+          amplitude *= .5;
+        }
+
+        for (int l = 0; l < 8 && i + l < count; l++) {
+          int wx = x * count + i + l;
+          uint32_t voxel = VoxelType::Empty;
+          if (density[l] > wy - params.base)
+            voxel = (wx + wy + wz) & 1 ? VoxelType::Light : VoxelType::Dark;
+          voxels[(k * count + j) * count + i + l] = voxel;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noise.hpp"
+
+#include <cstdint>
+
+namespace vx {
+
+enum VoxelType : uint32_t {
+  Empty = 0,
+  Light = 1,
+  Dark = 2,
+};
+
+// fills chunks with voxels. chunks are generated on the job system, so
+// generate has to be safe to call from several threads at once
+class TerrainGenerator {
+public:
+  virtual ~TerrainGenerator() = default;
+
+  // fills a count^3 grid indexed [z][y][x] for the chunk at chunk coordinates
+  // x, y, z
+  virtual void generate(int x, int y, int z, int count,
+    uint32_t *voxels) const = 0;
+};
+
+// the same checkered sphere sat on a floor in every chunk
+class SphereGenerator : public TerrainGenerator {
+public:
+  void generate(int x, int y, int z, int count,
+    uint32_t *voxels) const override;
+};
+
+struct NoiseParams {
+  uint32_t seed = 0;
+  NoiseKernel kernel = NoiseKernel::Simplex;
+
+  // size of the largest features, in voxels
+  float scale = 48;
+
+  // the surface sits around y = base and wanders height voxels either side
+  float base = -16;
+  float height = 16;
+
+  // each octave adds detail at twice the frequency and half the amplitude
+  int octaves = 3;
+};
+
+// hills with overhangs and floating bits, from fractal 3d noise evaluated 8
+// voxels at a time
+class NoiseGenerator : public TerrainGenerator {
+public:
+  NoiseGenerator(NoiseParams params = {}, Isa isa = best_isa());
+
+  void generate(int x, int y, int z, int count,
+    uint32_t *voxels) const override;
+
+private:
+  NoiseParams params;
+  Noise8 noise;
+};
+
+}
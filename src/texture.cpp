@@ -8,12 +8,24 @@
 using namespace vx;
 
 Texture::Texture(vx::Renderer &render, const char *path) {
-  create_image(render.pool(), path);
-  create_view(render.pool());
-  create_sampler(render.pool());
+  create(render, decode(path));
+}
+
+Job Texture::load_async(JobSystem &jobs, Renderer &render, std::string path,
+  std::function<void(std::shared_ptr<Texture>)> done) {
+  return jobs.spawn([&jobs, &render, path, done] {
+    auto pixels = decode(path.c_str());
+
+    // the uploader is only used from the main thread
+    jobs.on_main([&render, pixels, done] {
+      auto texture = std::shared_ptr<Texture>(new Texture());
+      texture->create(render, pixels);
+      done(texture);
+    });
+  });
 }
 
-void Texture::create_image(vx::CommandPool &pool, const char *path) {
+Texture::Pixels Texture::decode(const char *path) {
   // load raw pixel data
   int width, height, channels;
   stbi_uc *pixels = stbi_load(path, &width, &height, &channels,
@@ -21,15 +33,33 @@ void Texture::create_image(vx::CommandPool &pool, const char *path) {
   if (!pixels)
     throw std::runtime_error("could not open texture image :(");
 
+  return {
+    .data = std::shared_ptr<unsigned char>(pixels, stbi_image_free),
+    .width = width,
+    .height = height
+  };
+}
+
+void Texture::create(vx::Renderer &render, const Pixels &pixels) {
+  create_image(render, pixels);
+  create_view(render.pool());
+  create_sampler(render.pool());
+}
+
+void Texture::create_image(vx::Renderer &render, const Pixels &pixels) {
   // create image
-  pool.device().create_image(image_, mem_, width, height, 1, vk::Format::eR8G8B8A8Srgb,
-    vk::ImageTiling::eOptimal,
+  render.device().create_image(image_, mem_, pixels.width, pixels.height, 1,
+    vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal,
     vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
     vk::MemoryPropertyFlagBits::eDeviceLocal);
 
   // copy to image
-  pool.copy_to_image_staged(image_, pixels, width, height, 1, 16);
-  stbi_image_free(pixels);
+  render.uploader().image(image_, pixels.data.get(),
+    pixels.width * pixels.height * 4, {
+      static_cast<uint32_t>(pixels.width),
+      static_cast<uint32_t>(pixels.height),
+      1
+    });
 }
 
 void Texture::create_view(vx::CommandPool &pool) {
@@ -3,6 +3,11 @@
 #include <vulkan/vulkan_raii.hpp>
 
 #include "device.hpp"
+#include "jobs.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
 
 namespace vx {
 
@@ -12,18 +17,33 @@ class Texture {
 public:
   Texture(vx::Renderer &render, const char *path);
 
+  // decodes the image on a worker and uploads it on the main thread, calling
+  // done from the main thread once it's ready
+  static vx::Job load_async(vx::JobSystem &jobs, vx::Renderer &render,
+    std::string path, std::function<void(std::shared_ptr<Texture>)> done);
+
   vk::raii::Image &image() { return image_; }
-  vk::raii::DeviceMemory &mem() { return mem_; }
+  vx::Allocation &mem() { return mem_; }
   vk::raii::ImageView &view() { return view_; }
   vk::raii::Sampler &sampler() { return sampler_; }
 
 private:
+  // decoded rgba pixels
+  struct Pixels {
+    std::shared_ptr<unsigned char> data;
+    int width, height;
+  };
+
+  vx::Allocation mem_ = nullptr;
   vk::raii::Image image_ = nullptr;
-  vk::raii::DeviceMemory mem_ = nullptr;
   vk::raii::ImageView view_ = nullptr;
   vk::raii::Sampler sampler_ = nullptr;
 
-  void create_image(vx::CommandPool &pool, const char *path);
+  Texture() = default;
+
+  static Pixels decode(const char *path);
+  void create(vx::Renderer &render, const Pixels &pixels);
+  void create_image(vx::Renderer &render, const Pixels &pixels);
   void create_view(vx::CommandPool &pool);
   void create_sampler(vx::CommandPool &pool);
 };
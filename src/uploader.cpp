@@ -0,0 +1,311 @@
+#include "uploader.hpp"
+#include "device.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace vx;
+
+// buffer to image copies on queues without graphics or compute need offsets
+// that are multiples of 4, and wider alignment is kinder to dma engines
+static const vk::DeviceSize ALIGNMENT = 16;
+
+Uploader::Uploader(Device &device)
+  : device (device) {
+  pool = vk::raii::CommandPool(device.device(), vk::CommandPoolCreateInfo {
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = device.transfer_index()
+  });
+
+  vk::StructureChain timeline_info {
+    vk::SemaphoreCreateInfo {},
+    vk::SemaphoreTypeCreateInfo {
+      .semaphoreType = vk::SemaphoreType::eTimeline,
+      .initialValue = 0
+    }
+  };
+  timeline_ = vk::raii::Semaphore(device.device(), timeline_info.get());
+
+  device.create_buffer(ring, ring_mem, RING_SIZE,
+    vk::BufferUsageFlagBits::eTransferSrc,
+    vk::MemoryPropertyFlagBits::eHostVisible |
+    vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+Uploader::Batch &Uploader::batch() {
+  if (recording)
+    return *recording;
+
+  recording.emplace();
+  if (spare.empty()) {
+    vk::CommandBufferAllocateInfo alloc_info {
+      .commandPool = pool,
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = 1
+    };
+    recording->commands = std::move(
+      vk::raii::CommandBuffers(device.device(), alloc_info).front());
+  } else {
+    recording->commands = std::move(spare.back());
+    spare.pop_back();
+  }
+
+  recording->commands.begin({
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+  });
+  recording->done = recording->promise.get_future().share();
+  recording->ring_end = head;
+  return *recording;
+}
+
+vk::DeviceSize Uploader::stage(const void *data, vk::DeviceSize size,
+  vk::Buffer &src) {
+  if (size > RING_SIZE) {
+    Oversized staging;
+    device.create_buffer(staging.buffer, staging.mem, size,
+      vk::BufferUsageFlagBits::eTransferSrc,
+      vk::MemoryPropertyFlagBits::eHostVisible |
+      vk::MemoryPropertyFlagBits::eHostCoherent);
+    std::memcpy(staging.mem.mapped(), data, size);
+    src = *staging.buffer;
+    batch().oversized.push_back(std::move(staging));
+    return 0;
+  }
+
+  // copies never wrap around the end of the ring, so skip what's left of it
+  // if it's too small. the skip is taken first and freed with this batch,
+  // so once everything before it is done the copy always fits
+  vk::DeviceSize aligned = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  vk::DeviceSize offset = head % RING_SIZE;
+  if (offset + aligned > RING_SIZE) {
+    head += RING_SIZE - offset;
+    batch().ring_end = head;
+  }
+  while (head + aligned - tail > RING_SIZE)
+    wait_oldest();
+
+  offset = head % RING_SIZE;
+  head += aligned;
+  std::memcpy(static_cast<char *>(ring_mem.mapped()) + offset, data, size);
+  batch().ring_end = head;
+  src = *ring;
+  return offset;
+}
+
+void Uploader::wait_oldest() {
+  // the ring is full of what we're recording, so it has to go now. whatever
+  // is recorded next may be part of the same copy, so it waits for the same
+  // things
+  if (in_flight.empty() && recording) {
+    vk::Semaphore semaphore = recording->wait_semaphore;
+    uint64_t value = recording->wait_value;
+    submit();
+    if (semaphore)
+      after(semaphore, value);
+  }
+
+  // everything's been freed already, so waiting can't make room
+  if (in_flight.empty())
+    throw std::logic_error("upload ring full with nothing in flight");
+
+  uint64_t value = in_flight.front().value;
+  vk::SemaphoreWaitInfo wait_info {
+    .semaphoreCount = 1,
+    .pSemaphores = &*timeline_,
+    .pValues = &value
+  };
+  while (vk::Result::eTimeout ==
+    device.device().waitSemaphores(wait_info, UINT64_MAX));
+  poll();
+}
+
+Uploader::Done Uploader::buffer(vk::Buffer dst, vk::DeviceSize offset,
+  const void *data, vk::DeviceSize size) {
+  vk::Buffer src;
+  vk::DeviceSize src_offset = stage(data, size, src);
+
+  auto &current = batch();
+  current.commands.copyBuffer(src, dst, vk::BufferCopy {
+    .srcOffset = src_offset,
+    .dstOffset = offset,
+    .size = size
+  });
+  return current.done;
+}
+
+Uploader::Done Uploader::image(vk::Image dst, const void *data,
+  vk::DeviceSize size, vk::Extent3D extent) {
+  vk::Buffer src;
+  vk::DeviceSize src_offset = stage(data, size, src);
+
+  auto &current = batch();
+  vk::ImageSubresourceRange range {
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1
+  };
+
+  vk::ImageMemoryBarrier2 to_transfer {
+    .srcStageMask = vk::PipelineStageFlagBits2::eNone,
+    .srcAccessMask = {},
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .oldLayout = vk::ImageLayout::eUndefined,
+    .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .image = dst,
+    .subresourceRange = range
+  };
+  current.commands.pipelineBarrier2({
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &to_transfer
+  });
+
+  current.commands.copyBufferToImage(src, dst,
+    vk::ImageLayout::eTransferDstOptimal, vk::BufferImageCopy {
+      .bufferOffset = src_offset,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = { vk::ImageAspectFlagBits::eColor, 0, 0, 1 },
+      .imageOffset = {0, 0, 0},
+      .imageExtent = extent
+    });
+
+  // the frame waiting on this batch's timeline value covers the shader reads
+  vk::ImageMemoryBarrier2 to_shader {
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eNone,
+    .dstAccessMask = {},
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .image = dst,
+    .subresourceRange = range
+  };
+  current.commands.pipelineBarrier2({
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &to_shader
+  });
+
+  return current.done;
+}
+
+Uploader::Done Uploader::image(vk::Image dst, const void *data,
+  vk::DeviceSize size, std::vector<vk::BufferImageCopy> copies) {
+  vk::Buffer src;
+  vk::DeviceSize src_offset = stage(data, size, src);
+  for (auto &copy : copies)
+    copy.bufferOffset += src_offset;
+
+  auto &current = batch();
+  vk::ImageSubresourceRange range {
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1
+  };
+
+  // anything still reading the image is waited for with after, which the
+  // transfer stage here chains on to
+  vk::ImageMemoryBarrier2 to_transfer {
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = {},
+    .dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .image = dst,
+    .subresourceRange = range
+  };
+  current.commands.pipelineBarrier2({
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &to_transfer
+  });
+
+  current.commands.copyBufferToImage(src, dst,
+    vk::ImageLayout::eTransferDstOptimal, copies);
+
+  vk::ImageMemoryBarrier2 to_shader {
+    .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eNone,
+    .dstAccessMask = {},
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .image = dst,
+    .subresourceRange = range
+  };
+  current.commands.pipelineBarrier2({
+    .imageMemoryBarrierCount = 1,
+    .pImageMemoryBarriers = &to_shader
+  });
+
+  return current.done;
+}
+
+void Uploader::after(vk::Semaphore semaphore, uint64_t value) {
+  // only ever one semaphore, counting up, so the latest value covers the
+  // rest
+  auto &current = batch();
+  current.wait_semaphore = semaphore;
+  current.wait_value = std::max(current.wait_value, value);
+}
+
+uint64_t Uploader::submit() {
+  if (!recording)
+    return submitted;
+
+  auto &current = *recording;
+  current.commands.end();
+  current.value = ++submitted;
+
+  vk::CommandBufferSubmitInfo command_info {
+    .commandBuffer = current.commands
+  };
+  vk::SemaphoreSubmitInfo wait_info {
+    .semaphore = current.wait_semaphore,
+    .value = current.wait_value,
+    .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+  };
+  vk::SemaphoreSubmitInfo signal_info {
+    .semaphore = timeline_,
+    .value = current.value,
+    .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+  };
+  device.transfer_queue().submit2(vk::SubmitInfo2 {
+    .waitSemaphoreInfoCount = current.wait_semaphore ? 1u : 0u,
+    .pWaitSemaphoreInfos = &wait_info,
+    .commandBufferInfoCount = 1,
+    .pCommandBufferInfos = &command_info,
+    .signalSemaphoreInfoCount = 1,
+    .pSignalSemaphoreInfos = &signal_info
+  });
+
+  in_flight.push_back(std::move(current));
+  recording.reset();
+  return submitted;
+}
+
+void Uploader::poll() {
+  // batches go through one queue, so they finish in order
+  uint64_t done = timeline_.getCounterValue();
+  while (!in_flight.empty() && in_flight.front().value <= done) {
+    auto &finished = in_flight.front();
+    tail = finished.ring_end;
+    finished.promise.set_value();
+    finished.commands.reset();
+    spare.push_back(std::move(finished.commands));
+    in_flight.pop_front();
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "allocator.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+namespace vx {
+
+class Device;
+
+// copies data into device local buffers and images on the transfer queue
+// without the cpu waiting on it. everything is staged through one mapped ring
+// buffer and recorded into a batch, which Renderer submits once a frame. the
+// frame then waits on the gpu for the batch's timeline value, and callers who
+// care get a future for when their copy has landed
+class Uploader {
+public:
+  static const vk::DeviceSize RING_SIZE = 32 << 20;
+
+  using Done = std::shared_future<void>;
+
+  Uploader(vx::Device &device);
+
+  Uploader(const Uploader &that) = delete;
+  Uploader &operator=(const Uploader &that) = delete;
+
+  // copies size bytes of data to offset in dst. the data is copied out
+  // before this returns
+  Done buffer(vk::Buffer dst, vk::DeviceSize offset, const void *data,
+    vk::DeviceSize size);
+
+  // fills the whole of a freshly created colour image, leaving it in shader
+  // read only layout
+  Done image(vk::Image dst, const void *data, vk::DeviceSize size,
+    vk::Extent3D extent);
+
+  // overwrites boxes of a colour image already in shader read only layout,
+  // leaving it there. each copy's bufferOffset is where its texels start in
+  // data
+  Done image(vk::Image dst, const void *data, vk::DeviceSize size,
+    std::vector<vk::BufferImageCopy> copies);
+
+  // the batch being recorded overwrites something gpu work already submitted
+  // may still be reading, so it waits for semaphore to reach value first
+  void after(vk::Semaphore semaphore, uint64_t value);
+
+  // submits everything recorded since the last submit, returning the timeline
+  // value anything using the uploads has to wait for
+  uint64_t submit();
+
+  // resolves the futures of finished batches and reuses their ring space
+  void poll();
+
+  vk::Semaphore timeline() { return *timeline_; }
+
+private:
+  // for data too big for the ring, freed with its batch
+  struct Oversized {
+    vx::Allocation mem;
+    vk::raii::Buffer buffer = nullptr;
+  };
+
+  struct Batch {
+    vk::raii::CommandBuffer commands = nullptr;
+    uint64_t value = 0;
+
+    // how far into the ring this batch has staged
+    vk::DeviceSize ring_end = 0;
+
+    std::promise<void> promise;
+    Done done;
+    std::vector<Oversized> oversized;
+
+    // see after
+    vk::Semaphore wait_semaphore = nullptr;
+    uint64_t wait_value = 0;
+  };
+
+  vx::Device &device;
+  vk::raii::CommandPool pool = nullptr;
+  vk::raii::Semaphore timeline_ = nullptr;
+  uint64_t submitted = 0;
+
+  vx::Allocation ring_mem;
+  vk::raii::Buffer ring = nullptr;
+
+  // bytes ever staged and ever freed, so what's in use is head - tail and
+  // head % RING_SIZE is where the next copy goes
+  vk::DeviceSize head = 0;
+  vk::DeviceSize tail = 0;
+
+  std::optional<Batch> recording;
+  std::deque<Batch> in_flight;
+  std::vector<vk::raii::CommandBuffer> spare;
+
+  Batch &batch();
+  vk::DeviceSize stage(const void *data, vk::DeviceSize size,
+    vk::Buffer &src);
+  void wait_oldest();
+};
+
+}
@@ -0,0 +1,299 @@
+#include "world.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vx;
+
+static int distance_sq(const ChunkPos &a, const ChunkPos &b) {
+  int dx = a.x - b.x;
+  int dy = a.y - b.y;
+  int dz = a.z - b.z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+static int floor_div(int a, int b) {
+  return a / b - (a % b < 0);
+}
+
+const char *vx::to_string(DrawPath path) {
+  switch (path) {
+    case DrawPath::PerChunk: return "per chunk";
+    case DrawPath::Bindless: return "bindless";
+    case DrawPath::Grid: return "grid";
+    case DrawPath::Compute: return "compute";
+    case DrawPath::Clipmap: return "clipmap";
+  }
+  return "unknown";
+}
+
+World::World(JobSystem &jobs, const TerrainGenerator &terrain, int radius,
+  std::chrono::microseconds budget)
+  : jobs (jobs)
+  , terrain (terrain)
+  , radius_ (radius)
+  , budget (budget) { }
+
+World::~World() {
+  // their main thread callbacks are left queued, and never run as nothing
+  // calls run_main for this world again
+  jobs.wait(jobs.spawn([] { }, running));
+}
+
+uint32_t World::capacity(int radius) {
+  // chunks are only evicted once they are past radius + 1, and evicted chunks
+  // keep their descriptors until the frames in flight are done with them
+  int r = radius + 1;
+  uint32_t count = 0;
+  for (int x = -r; x <= r; x++) {
+    for (int y = -r; y <= r; y++) {
+      for (int z = -r; z <= r; z++) {
+        if (x * x + y * y + z * z <= r * r)
+          count++;
+      }
+    }
+  }
+
+  return count * 2;
+}
+
+void World::update(Renderer &render, const Camera &camera) {
+  glm::vec3 pos = camera.position() / static_cast<float>(Chunk::SIZE);
+  ChunkPos current {
+    static_cast<int>(std::floor(pos.x)),
+    static_cast<int>(std::floor(pos.y)),
+    static_cast<int>(std::floor(pos.z))
+  };
+
+  // the set of chunks we want only changes when the camera crosses into a
+  // new chunk
+  if (!has_centre || current != centre) {
+    centre = current;
+    has_centre = true;
+    evict(render);
+    queue_missing();
+  }
+
+  spawn_jobs();
+  stream(render);
+
+  for (auto &pos : edited) {
+    auto it = chunks.find(pos);
+    if (it != chunks.end()) {
+      it->second->flush(render);
+      invalidate(pos);
+    }
+  }
+  edited.clear();
+
+  if (path_ != DrawPath::Clipmap)
+    return;
+
+  // the whole window is filled in when it's made, so only changes after
+  // that need invalidating
+  if (!clipmap)
+    clipmap = std::make_unique<Clipmap>(render, Chunk::COUNT);
+  clipmap->update(render, jobs, camera.position(), [&](glm::ivec3 pos) {
+    auto it = chunks.find({ pos.x, pos.y, pos.z });
+    return it == chunks.end() ? nullptr : &it->second->octree();
+  });
+}
+
+void World::set_path(DrawPath path) {
+  if (clipmap && path != path_)
+    clipmap->reset();
+  path_ = path;
+}
+
+void World::invalidate(const ChunkPos &pos) {
+  if (!clipmap || path_ != DrawPath::Clipmap)
+    return;
+  glm::ivec3 lo = glm::ivec3(pos.x, pos.y, pos.z) * Chunk::COUNT;
+  clipmap->invalidate(lo, lo + Chunk::COUNT);
+}
+
+void World::evict(Renderer &render) {
+  // a bit of slack past the radius stops chunks on the edge from thrashing
+  // when the camera wobbles across a chunk boundary
+  int r = radius_ + 1;
+  for (auto it = chunks.begin(); it != chunks.end();) {
+    if (distance_sq(it->first, centre) > r * r) {
+      invalidate(it->first);
+      render.retire(std::shared_ptr<Chunk>(std::move(it->second)));
+      it = chunks.erase(it);
+      evicted++;
+    } else it++;
+  }
+}
+
+void World::queue_missing() {
+  pending.clear();
+  int r = radius_;
+  for (int x = -r; x <= r; x++) {
+    for (int y = -r; y <= r; y++) {
+      for (int z = -r; z <= r; z++) {
+        ChunkPos pos { centre.x + x, centre.y + y, centre.z + z };
+        if (x * x + y * y + z * z <= r * r && !chunks.contains(pos) &&
+            !generating.contains(pos))
+          pending.push_back(pos);
+      }
+    }
+  }
+
+  // load the nearest chunks first
+  std::sort(pending.begin(), pending.end(),
+    [&](const ChunkPos &a, const ChunkPos &b) {
+      return distance_sq(a, centre) > distance_sq(b, centre);
+    });
+}
+
+void World::spawn_jobs() {
+  // keep a few jobs per worker in flight rather than everything pending, so
+  // we don't waste time on chunks the camera has already moved away from
+  size_t max_jobs = jobs.thread_count() * 4;
+  std::erase_if(running, [](const Job &job) { return job.done(); });
+  while (!pending.empty() && generating.size() < max_jobs) {
+    ChunkPos pos = pending.back();
+    pending.pop_back();
+    generating.insert(pos);
+
+    // the job only touches the world from the main thread callback, and
+    // the world waits for it before it goes
+    running.push_back(jobs.spawn([&jobs = jobs, &terrain = terrain, this,
+      pos] {
+      auto data = std::make_shared<Chunk::Data>(
+        Chunk::generate(terrain, pos.x, pos.y, pos.z));
+      jobs.on_main([this, data] { generated.push_back(data); });
+    }));
+  }
+}
+
+void World::stream(Renderer &render) {
+  jobs.run_main();
+
+  // always make some progress, even if a single chunk blows the budget
+  auto start = std::chrono::steady_clock::now();
+  while (!generated.empty()) {
+    auto data = std::move(generated.back());
+    generated.pop_back();
+
+    // the camera may have moved on while the chunk was being generated
+    ChunkPos pos { data->x, data->y, data->z };
+    generating.erase(pos);
+    int r = radius_ + 1;
+    if (distance_sq(pos, centre) > r * r)
+      continue;
+
+    chunks.emplace(pos, std::make_unique<Chunk>(render, std::move(*data)));
+    invalidate(pos);
+    if (std::chrono::steady_clock::now() - start >= budget)
+      break;
+  }
+}
+
+void World::set_voxel(glm::ivec3 pos, uint32_t voxel) {
+  fill_box(pos, pos + 1, voxel);
+}
+
+void World::fill_box(glm::ivec3 lo, glm::ivec3 hi, uint32_t voxel) {
+  edit(lo, hi, [&](Chunk &chunk, glm::ivec3 origin) {
+    chunk.fill_box(lo - origin, hi - origin, voxel);
+  });
+}
+
+void World::fill_sphere(glm::vec3 centre, float radius, uint32_t voxel) {
+  glm::ivec3 lo(glm::floor(centre - radius));
+  glm::ivec3 hi(glm::ceil(centre + radius));
+  edit(lo, hi, [&](Chunk &chunk, glm::ivec3 origin) {
+    chunk.fill_sphere(centre - glm::vec3(origin), radius, voxel);
+  });
+}
+
+void World::edit(glm::ivec3 lo, glm::ivec3 hi,
+  const std::function<void(Chunk &, glm::ivec3)> &edit) {
+  // every loaded chunk the half open box touches, with the edit given the
+  // voxel coordinates of the chunk's corner
+  for (int z = floor_div(lo.z, Chunk::COUNT);
+      z <= floor_div(hi.z - 1, Chunk::COUNT); z++) {
+    for (int y = floor_div(lo.y, Chunk::COUNT);
+        y <= floor_div(hi.y - 1, Chunk::COUNT); y++) {
+      for (int x = floor_div(lo.x, Chunk::COUNT);
+          x <= floor_div(hi.x - 1, Chunk::COUNT); x++) {
+        ChunkPos pos { x, y, z };
+        auto it = chunks.find(pos);
+        if (it == chunks.end())
+          continue;
+        edit(*it->second, glm::ivec3(x, y, z) * Chunk::COUNT);
+        edited.insert(pos);
+      }
+    }
+  }
+}
+
+void World::render(Renderer &render) {
+  if (path_ == DrawPath::Clipmap) {
+    render.begin_rendering();
+    if (clipmap)
+      clipmap->draw(render);
+    return;
+  }
+
+  if (path_ == DrawPath::Grid || path_ == DrawPath::Compute) {
+    // everything not yet evicted fits, and chunks of nothing but air are
+    // left out so the rays step straight over them
+    int r = radius_ + 1;
+    int size = 2 * r + 1;
+    glm::ivec3 origin(centre.x - r, centre.y - r, centre.z - r);
+    grid.assign(size * size * size, 0);
+    for (auto &[pos, chunk] : chunks) {
+      glm::ivec3 cell = glm::ivec3(pos.x, pos.y, pos.z) - origin;
+      if (glm::any(glm::lessThan(cell, glm::ivec3(0))) ||
+          glm::any(glm::greaterThanEqual(cell, glm::ivec3(size))) ||
+          chunk->empty())
+        continue;
+      size_t i = (cell.z * size + cell.y) * size + cell.x;
+      grid[i] = chunk->info().slot + 1;
+    }
+
+    if (path_ == DrawPath::Compute) {
+      render.bindless().trace(Chunk::COUNT, grid, origin, size);
+      render.begin_rendering();
+      return;
+    }
+
+    render.begin_rendering();
+    render.bindless().draw_grid(Chunk::COUNT, grid, origin, size);
+    return;
+  }
+
+  if (path_ == DrawPath::PerChunk && parallel_ &&
+      chunks.size() >= PARALLEL_MIN) {
+    // the map can't be split up by index, so flatten it first
+    drawn.clear();
+    for (auto &[pos, chunk] : chunks)
+      drawn.push_back(chunk.get());
+
+    render.begin_rendering(true);
+    render.draw_parallel(jobs, drawn.size(), Chunk::COUNT,
+      [&](vk::raii::CommandBuffer &commands, size_t i) {
+        drawn[i]->render(render, commands);
+      });
+    return;
+  }
+
+  if (path_ == DrawPath::PerChunk) {
+    render.begin_rendering();
+    render.bind_chunk_pipeline(Chunk::COUNT);
+    for (auto &[pos, chunk] : chunks)
+      chunk->render(render);
+    return;
+  }
+
+  // culling is a compute pass, so it goes in before rendering starts
+  infos.clear();
+  for (auto &[pos, chunk] : chunks)
+    infos.push_back(chunk->info());
+  render.bindless().cull(infos);
+  render.begin_rendering();
+  render.bindless().draw(Chunk::COUNT);
+}
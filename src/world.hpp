@@ -0,0 +1,183 @@
+#pragma once
+
+#include "camera.hpp"
+#include "chunk.hpp"
+#include "clipmap.hpp"
+#include "jobs.hpp"
+#include "renderer.hpp"
+#include "terrain.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace vx {
+
+struct ChunkPos {
+  int x, y, z;
+
+  bool operator==(const ChunkPos &other) const = default;
+};
+
+}
+
+namespace std {
+
+template<> struct hash<vx::ChunkPos> {
+  size_t operator()(vx::ChunkPos const &pos) const {
+    // primes from teschner et al's spatial hashing
+    return (static_cast<size_t>(pos.x) * 73856093) ^
+      (static_cast<size_t>(pos.y) * 19349663) ^
+      (static_cast<size_t>(pos.z) * 83492791);
+  }
+};
+
+}
+
+namespace vx {
+
+// how World::render draws the chunks
+enum class DrawPath {
+  // a draw and a descriptor bind per chunk
+  PerChunk,
+
+  // one indirect draw through Renderer::bindless, culled on the gpu
+  Bindless,
+
+  // one full screen pass through Renderer::bindless, stepping through a
+  // grid of the chunks and only marching the ones it passes
+  Grid,
+
+  // the same as Grid but traced by a compute pass in 8x8 tiles, and
+  // composited into the frame at the end
+  Compute,
+
+  // one full screen pass over a Clipmap around the camera, which never looks
+  // at the chunks themselves
+  Clipmap
+};
+
+// how many there are, for cycling through them
+const int DRAW_PATHS = 5;
+
+const char *to_string(DrawPath path);
+
+struct WorldStats {
+  size_t resident;
+  size_t pending;
+  size_t evicted;
+};
+
+// owns every loaded chunk and streams them in and out around the camera.
+// chunks are generated on the job system and uploaded on the main thread
+class World {
+public:
+  World(vx::JobSystem &jobs, const vx::TerrainGenerator &terrain, int radius,
+    std::chrono::microseconds budget = std::chrono::milliseconds(2));
+
+  // waits for any generation jobs still running, as they use the terrain
+  // generator and the world
+  ~World();
+
+  World(const World &that) = delete;
+  World &operator=(const World &that) = delete;
+
+  // the most chunks that can be alive at once for a given radius, for sizing
+  // the renderer's descriptor pool
+  static uint32_t capacity(int radius);
+
+  void update(vx::Renderer &render, const vx::Camera &camera);
+
+  // between Renderer::begin_frame and end_frame. calls begin_rendering itself,
+  // after any compute work it needs
+  void render(vx::Renderer &render);
+
+  // edits in world voxel coordinates, Chunk::COUNT voxels to a chunk. only
+  // chunks that are loaded get changed, and the changes reach the gpu at the
+  // next update
+  void set_voxel(glm::ivec3 pos, uint32_t voxel);
+  void fill_box(glm::ivec3 lo, glm::ivec3 hi, uint32_t voxel);
+  void fill_sphere(glm::vec3 centre, float radius, uint32_t voxel);
+
+  vx::DrawPath path() { return path_; }
+
+  // the clipmap isn't kept up to date while something else is drawing, so
+  // it's filled in from scratch on switching back to it
+  void set_path(vx::DrawPath path);
+
+  // records the per chunk draws on the job system, split across a secondary
+  // command buffer per thread, once there are enough of them to be worth it
+  bool parallel() { return parallel_; }
+  void set_parallel(bool parallel) { parallel_ = parallel; }
+
+  int radius() { return radius_; }
+  void set_radius(int radius) {
+    radius_ = radius;
+    has_centre = false;
+  }
+
+  WorldStats stats() {
+    return {
+      .resident = chunks.size(),
+      .pending = pending.size() + generating.size(),
+      .evicted = evicted
+    };
+  }
+
+private:
+  vx::JobSystem &jobs;
+  const vx::TerrainGenerator &terrain;
+  int radius_;
+  std::chrono::microseconds budget;
+
+  std::unordered_map<ChunkPos, std::unique_ptr<Chunk>> chunks;
+
+  // chunks still to be generated, nearest to the camera last
+  std::vector<ChunkPos> pending;
+
+  // chunks with a generation job in flight or waiting to be uploaded
+  std::unordered_set<ChunkPos> generating;
+
+  // the generation jobs that might not have finished yet
+  std::vector<vx::Job> running;
+
+  // chunks generated by the job system, handed over on the main thread
+  std::vector<std::shared_ptr<Chunk::Data>> generated;
+
+  // chunks with edits waiting to be uploaded
+  std::unordered_set<ChunkPos> edited;
+
+  size_t evicted = 0;
+
+  vx::DrawPath path_ = DrawPath::Bindless;
+  std::vector<ChunkInfo> infos;
+
+  // the chunks around the centre for DrawPath::Grid and Compute, rebuilt
+  // every frame
+  std::vector<uint32_t> grid;
+
+  // made the first time it's drawn with, and kept up to date from then on
+  std::unique_ptr<vx::Clipmap> clipmap;
+
+  // fewer chunks than this are drawn straight into the frame's commands
+  static const size_t PARALLEL_MIN = 256;
+  bool parallel_ = true;
+  std::vector<Chunk *> drawn;
+
+  ChunkPos centre;
+  bool has_centre = false;
+
+  void evict(vx::Renderer &render);
+  void queue_missing();
+  void spawn_jobs();
+  void stream(vx::Renderer &render);
+  void invalidate(const ChunkPos &pos);
+  void edit(glm::ivec3 lo, glm::ivec3 hi,
+    const std::function<void(Chunk &, glm::ivec3)> &edit);
+};
+
+}